@@ -0,0 +1,35 @@
+#!/usr/bin/env python3
+"""Static file server for the built pages that makes them cross-origin isolated.
+
+The COOP/COEP headers are needed for SharedArrayBuffer, which the multi
+simulation page uses to run its simulations in workers. Without them the page
+falls back to stepping on the main thread.
+
+    python3 scripts/serve.py [--port 8000] [--directory dist]
+"""
+import argparse
+import functools
+import http.server
+
+
+class IsolatedHandler(http.server.SimpleHTTPRequestHandler):
+    def end_headers(self):
+        self.send_header('Cross-Origin-Opener-Policy', 'same-origin')
+        self.send_header('Cross-Origin-Embedder-Policy', 'require-corp')
+        super().end_headers()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--port', type=int, default=8000)
+    parser.add_argument('--directory', default='.')
+    args = parser.parse_args()
+
+    handler = functools.partial(IsolatedHandler, directory=args.directory)
+    with http.server.ThreadingHTTPServer(('', args.port), handler) as server:
+        print(f'Serving {args.directory} on http://localhost:{args.port}/')
+        server.serve_forever()
+
+
+if __name__ == '__main__':
+    main()
@@ -1,6 +1,7 @@
 import { CellType, WasmExports } from './types.js';
 import { memset, memcpy, wasmLoad } from './wasm/utils.js';
 import { Grid3DRenderer } from './renderer/Grid3DRenderer.js';
+import { WasmGridSource } from './renderer/GridSource.js';
 import { createUI } from './ui/ui.js';
 
 document.addEventListener("DOMContentLoaded", main, false);
@@ -104,7 +105,9 @@ async function main() {
                 randomInt: (min: number, max: number) => {
                     // Generate a random number between min and max (inclusive)
                     return Math.floor(Math.random() * (max - min + 1)) + min;
-                }
+                },
+                // Clock of the step profiler, only used by PROFILE=1 builds
+                profiler_now: (): number => performance.now()
             },
         };
 
@@ -116,7 +119,7 @@ async function main() {
         // wasm.create_demo_grid();
         
         // Create the 3D renderer, passing the crosshair element
-        const gridRenderer = new Grid3DRenderer(wasm, container, crosshair);
+        const gridRenderer = new Grid3DRenderer(new WasmGridSource(wasm, memory), container, crosshair);
         
         // Try to load the first map (if available)
         try {
@@ -1,44 +1,110 @@
 import { CellType, WasmExports } from './types.js';
-import { memset, memcpy, wasmLoad } from './wasm/utils.js';
+import { memset, memcpy, wasmCompile, wasmInstantiate } from './wasm/utils.js';
 import { Grid3DRenderer } from './renderer/Grid3DRenderer.js';
+import { GridSource, WasmGridSource } from './renderer/GridSource.js';
+import { WorkerEngine } from './worker/worker-engine.js';
+import { EngineMetrics, readEngineMetrics } from './worker/shared-grid.js';
 
 const params = new URLSearchParams(window.location.search);
 const mapParam = params.get('map') ?? "0";
 const mapIndex = parseInt(mapParam, 10);
+// The simulations step in workers when the page is cross-origin isolated,
+// ?worker=0 keeps them on the main thread
+const useWorkers = params.get('worker') !== '0' && WorkerEngine.isSupported();
 
 document.addEventListener("DOMContentLoaded", main, false);
 
-interface GlobalStats {
-    steps: number[];
-    minSteps: number;
-    maxSteps: number;
-    avgSteps: number;
-    variance: number;
-    makespans: number[];
-    minMakespan: number;
-    maxMakespan: number;
-    avgMakespan: number;
-    varMakespan: number;
-    tTotals: number[];
-    minTTotal: number;
-    maxTTotal: number;
-    avgTTotal: number;
-    varTTotal: number;
-    tMaxs: number[];
-    minTMax: number;
-    maxTMax: number;
-    avgTMax: number;
-    varTMax: number;
-    eTotals: number[];
-    minETotal: number;
-    maxETotal: number;
-    avgETotal: number;
-    varETotal: number;
-    eMaxs: number[];
-    minEMax: number;
-    maxEMax: number;
-    avgEMax: number;
-    varEMax: number;
+// Summary of one metric over a set of slots (one per simulation, or one per
+// replicate in compute mode). The count and sums are updated in place, so an
+// update costs the same for any number of slots; min and max are only searched
+// again after the value that held one of them changed. The metrics are integers,
+// so the sums are exact.
+class MetricSummary {
+    private values: number[] = []; // NaN for an empty slot
+    private count = 0;
+    private sum = 0;
+    private sumSquares = 0;
+    private minValue = Infinity;
+    private maxValue = -Infinity;
+    private extremaStale = false;
+
+    constructor(size: number) {
+        this.clear(size);
+    }
+
+    clear(size: number): void {
+        this.values = Array(size).fill(NaN);
+        this.count = 0;
+        this.sum = 0;
+        this.sumSquares = 0;
+        this.minValue = Infinity;
+        this.maxValue = -Infinity;
+        this.extremaStale = false;
+    }
+
+    set(slot: number, value: number): void {
+        const old = this.values[slot];
+        if (old === value || (isNaN(old) && isNaN(value))) return;
+        if (isFinite(old)) {
+            this.count--;
+            this.sum -= old;
+            this.sumSquares -= old * old;
+            if (old === this.minValue || old === this.maxValue) this.extremaStale = true;
+        }
+        this.values[slot] = value;
+        if (isFinite(value)) {
+            this.count++;
+            this.sum += value;
+            this.sumSquares += value * value;
+            if (value < this.minValue) this.minValue = value;
+            if (value > this.maxValue) this.maxValue = value;
+        }
+    }
+
+    private refreshExtrema(): void {
+        if (!this.extremaStale) return;
+        this.minValue = Infinity;
+        this.maxValue = -Infinity;
+        for (const value of this.values) {
+            if (!isFinite(value)) continue;
+            if (value < this.minValue) this.minValue = value;
+            if (value > this.maxValue) this.maxValue = value;
+        }
+        this.extremaStale = false;
+    }
+
+    min(): number {
+        this.refreshExtrema();
+        return this.count > 0 ? this.minValue : NaN;
+    }
+
+    max(): number {
+        this.refreshExtrema();
+        return this.count > 0 ? this.maxValue : NaN;
+    }
+
+    mean(): number {
+        return this.count > 0 ? this.sum / this.count : NaN;
+    }
+
+    // Population variance
+    variance(): number {
+        if (this.count === 0) return NaN;
+        if (this.count === 1) return 0;
+        const mean = this.sum / this.count;
+        return Math.max(0, this.sumSquares / this.count - mean * mean);
+    }
+}
+
+// Rows of the global statistics panel, by the id suffix of their elements
+const GLOBAL_METRICS = ['makespan', 'ttotal', 'tmax', 'etotal', 'emax'] as const;
+type GlobalMetric = typeof GLOBAL_METRICS[number];
+
+interface SummaryElements {
+    max: HTMLElement | null;
+    min: HTMLElement | null;
+    avg: HTMLElement | null;
+    var: HTMLElement | null;
 }
 
 interface SimulationMetrics {
@@ -51,6 +117,13 @@ interface SimulationMetrics {
     e_max: number;
 }
 
+// The module and memory that host every simulation on the main thread, one engine context each
+interface MainThreadEngine {
+    wasm: WasmExports;
+    memory: WebAssembly.Memory;
+    claimed: number; // Contexts given to simulations
+}
+
 interface StatsElements {
     steps: HTMLElement | null;
     robots: HTMLElement | null;
@@ -63,7 +136,9 @@ interface StatsElements {
 
 interface Simulation {
     index: number;
-    wasm: WasmExports;
+    wasm: WasmExports | null;       // Engine on the main thread
+    context: number;                // Engine context of the simulation in `wasm`
+    engine: WorkerEngine | null;    // Or the engine in a worker
     gridRenderer: Grid3DRenderer;
     running: boolean;
     animFrameId: number | null;
@@ -74,40 +149,25 @@ interface Simulation {
 }
 
 const NUM_SIMULATIONS = 15;
+const MAX_STEPS_PER_FRAME = 64; // Per simulation, at high speeds
+
+// Compute mode: every simulation runs replicates to completion without pacing
+const COMPUTE_SAMPLED_VIEWS = 3;    // Views kept up to date while computing
+const COMPUTE_REFRESH_MS = 250;     // Refresh period of the statistics and the sampled views
+const COMPUTE_SLICE_STEPS = 256;    // Steps per task when computing on the main thread
+let computing = false;
+let computeResults = false;         // The global statistics hold replicates, not the live views
 
 // Statistics tracking
-const globalStats: GlobalStats = {
-    steps: Array(NUM_SIMULATIONS).fill(NaN),
-    minSteps: Infinity,
-    maxSteps: 0,
-    avgSteps: 0,
-    variance: 0,
-    makespans: Array(NUM_SIMULATIONS).fill(NaN),
-    minMakespan: Infinity,
-    maxMakespan: 0,
-    avgMakespan: 0,
-    varMakespan: 0,
-    tTotals: Array(NUM_SIMULATIONS).fill(NaN),
-    minTTotal: Infinity,
-    maxTTotal: 0,
-    avgTTotal: 0,
-    varTTotal: 0,
-    tMaxs: Array(NUM_SIMULATIONS).fill(NaN),
-    minTMax: Infinity,
-    maxTMax: 0,
-    avgTMax: 0,
-    varTMax: 0,
-    eTotals: Array(NUM_SIMULATIONS).fill(NaN),
-    minETotal: Infinity,
-    maxETotal: 0,
-    avgETotal: 0,
-    varETotal: 0,
-    eMaxs: Array(NUM_SIMULATIONS).fill(NaN),
-    minEMax: Infinity,
-    maxEMax: 0,
-    avgEMax: 0,
-    varEMax: 0
+const globalStats: Record<GlobalMetric, MetricSummary> = {
+    makespan: new MetricSummary(NUM_SIMULATIONS),
+    ttotal: new MetricSummary(NUM_SIMULATIONS),
+    tmax: new MetricSummary(NUM_SIMULATIONS),
+    etotal: new MetricSummary(NUM_SIMULATIONS),
+    emax: new MetricSummary(NUM_SIMULATIONS)
 };
+let globalStatsElements: Record<GlobalMetric, SummaryElements> | null = null; // Looked up on the first draw
+let globalStatsFrame: number | null = null;
 
 // Parse speed and pvalue from URL params
 const speedParam = params.get('speed');
@@ -116,18 +176,20 @@ const defaultSpeed = speedParam ? parseFloat(speedParam) : 1.0;
 const defaultPValue = pvalueParam ? parseInt(pvalueParam, 10) : 50;
 const simulations: Simulation[] = [];
 
-document.addEventListener("DOMContentLoaded", main, false);
-
 async function main(): Promise<void> {
     // Hide loading message once everything is initialized
     const loadingElement = document.getElementById('loading');
     const container = document.getElementById('simulations-container');
     
     try {
+        // Compile once for every simulation
+        const wasmModule = await wasmCompile("main.wasm");
+        const mainThreadEngine = useWorkers ? null : await createEngine(wasmModule);
+
         // Create multiple simulation instances
         for (let i = 0; i < NUM_SIMULATIONS; i++) {
             try {
-                const sim = await createSimulationInstance(i);
+                const sim = await createSimulationInstance(i, wasmModule, mainThreadEngine);
                 simulations.push(sim);
             } catch (error) {
                 console.error(`Error creating simulation ${i}:`, error);
@@ -155,7 +217,7 @@ async function main(): Promise<void> {
     }
 }
 
-async function createSimulationInstance(index: number): Promise<Simulation> {
+async function createSimulationInstance(index: number, wasmModule: WebAssembly.Module, mainThreadEngine: MainThreadEngine | null): Promise<Simulation> {
     // Create a container for this simulation instance
     const simulationContainer = document.createElement('div');
     simulationContainer.className = 'simulation-container';
@@ -189,63 +251,24 @@ async function createSimulationInstance(index: number): Promise<Simulation> {
     crosshair.style.display = 'none'; // We don't need crosshairs for these simulations
     sceneContainer.appendChild(crosshair);
     
-    // Set up memory for WebAssembly
-    const memory = new WebAssembly.Memory({ initial: 100, maximum: 1000, shared: false });
-    
-    const imports = {
-        env: {
-            console_log: (code: number): void => {
-                // We can limit console output to avoid flooding console
-                if (code === 5001 || code === 5002) { // Start/End simulation step
-                    console.log(`Sim ${index} - Code ${code}`);
-                }
-            },
-            memory: memory,
-            memset: (ptr: number, value: number, size: number): number => {
-                return memset(ptr, value, size, memory);
-            },
-            memcpy: (dest: number, src: number, len: number): number => {
-                return memcpy(dest, src, len, memory);
-            },
-            randomInt: (min: number, max: number): number => {
-                return Math.floor(Math.random() * (max - min + 1)) + min;
-            }
-        },
-    };
-
-    // Load the WebAssembly module
-    const wasm: WasmExports = await wasmLoad("main.wasm", imports);
-
-    // Set pvalue if available
-    if (typeof wasm.set_active_probability === 'function') {
-        wasm.set_active_probability(defaultPValue);
+    let wasm: WasmExports | null = null;
+    let context = -1;
+    let engine: WorkerEngine | null = null;
+    let source: GridSource;
+    if (mainThreadEngine) {
+        wasm = mainThreadEngine.wasm;
+        context = claimContext(mainThreadEngine);
+        wasm.select_context(context);
+        loadSimulationMap(wasm, index);
+        source = new WasmGridSource(wasm, mainThreadEngine.memory, context);
+    } else {
+        engine = await WorkerEngine.create(wasmModule);
+        await engine.load(pickMap(index, engine.mapCount), defaultPValue);
+        source = engine.source;
     }
 
     // Create a 3D renderer
-    const gridRenderer = new Grid3DRenderer(wasm, sceneContainer, crosshair);
-    
-    // --- Load map from URL param if present ---
-    // Only do this for the first simulation (index 0)
-    let mapLoadedFromUrl = false;
-    if (mapParam !== null) {
-        if (!isNaN(mapIndex) && wasm.get_map_count && mapIndex >= 0 && mapIndex < wasm.get_map_count()) {
-            wasm.load_map(mapIndex);
-            mapLoadedFromUrl = true;
-        }
-    }
-
-    // If not loaded from URL, use random map as before
-    if (!mapLoadedFromUrl) {
-        console.log("Map id not found in URL, loading random map");
-        const mapCount = wasm.get_map_count();
-        if (mapCount > 0) {
-            const randomMapIndex = Math.floor(Math.random() * mapCount);
-            console.log(`Simulation ${index}: Loading map ${randomMapIndex} of ${mapCount}`);
-            wasm.load_map(randomMapIndex);
-        } else {
-            wasm.create_demo_grid();
-        }
-    }
+    const gridRenderer = new Grid3DRenderer(source, sceneContainer, crosshair);
     
     // Set default transparencies
     gridRenderer.setMaterialOpacity(CellType.WALL, 0);     // 0% (fully transparent)
@@ -261,23 +284,17 @@ async function createSimulationInstance(index: number): Promise<Simulation> {
     gridRenderer.setupCameraView(1.8, true, orbitSpeed);
     
     // Create simulation object
-    const simulation = {
+    const simulation: Simulation = {
         index,
         wasm,
+        context,
+        engine,
         gridRenderer,
         running: false,
         animFrameId: null,
         lastStepTime: 0,
         stepInterval: 300 / defaultSpeed, // ms, adjust as needed
-        metrics: {
-            steps: 0,
-            robots: wasm.get_robot_count ? wasm.get_robot_count() : 0,
-            makespan: wasm.get_makespan ? wasm.get_makespan() : 0,
-            t_total: wasm.get_t_total ? wasm.get_t_total() : 0,
-            t_max: wasm.get_t_max ? wasm.get_t_max() : 0,
-            e_total: wasm.get_e_total ? wasm.get_e_total() : 0,
-            e_max: wasm.get_e_max ? wasm.get_e_max() : 0
-        },
+        metrics: { steps: 0, robots: 0, makespan: 0, t_total: 0, t_max: 0, e_total: 0, e_max: 0 },
         statsElements: {
             steps: document.getElementById(`steps-${index}`),
             robots: document.getElementById(`robots-${index}`),
@@ -290,40 +307,147 @@ async function createSimulationInstance(index: number): Promise<Simulation> {
     };
 
     // Update the robot count display
+    readMetrics(simulation);
     updateSimulationStats(simulation);
     
     return simulation;
 }
 
+// Instantiates the module that hosts the simulations on the main thread
+async function createEngine(wasmModule: WebAssembly.Module): Promise<MainThreadEngine> {
+    // Set up memory for WebAssembly, it grows with every engine context
+    const memory = new WebAssembly.Memory({ initial: 100, maximum: 1000, shared: false });
+    
+    const imports = {
+        env: {
+            console_log: (code: number): void => {
+                // We can limit console output to avoid flooding console
+                if (code === 5001 || code === 5002) { // Start/End simulation step
+                    console.log(`Sim - Code ${code}`);
+                }
+            },
+            memory: memory,
+            memset: (ptr: number, value: number, size: number): number => {
+                return memset(ptr, value, size, memory);
+            },
+            memcpy: (dest: number, src: number, len: number): number => {
+                return memcpy(dest, src, len, memory);
+            },
+            randomInt: (min: number, max: number): number => {
+                return Math.floor(Math.random() * (max - min + 1)) + min;
+            },
+            // Clock of the step profiler, only used by PROFILE=1 builds
+            profiler_now: (): number => performance.now()
+        },
+    };
+
+    const wasm = await wasmInstantiate<WasmExports>(wasmModule, imports);
+    return { wasm, memory, claimed: 0 };
+}
+
+// The first simulation gets the context the module starts with
+function claimContext(engine: MainThreadEngine): number {
+    const context = engine.claimed === 0 ? 0 : engine.wasm.create_context();
+    if (context < 0) throw new Error('No room for another engine context');
+    engine.claimed++;
+    return context;
+}
+
+// Loads the map of a simulation into the selected context
+function loadSimulationMap(wasm: WasmExports, index: number): void {
+    // Set pvalue if available
+    if (typeof wasm.set_active_probability === 'function') {
+        wasm.set_active_probability(defaultPValue);
+    }
+
+    const map = pickMap(index, wasm.get_map_count());
+    if (map >= 0) {
+        wasm.load_map(map);
+    } else {
+        wasm.create_demo_grid();
+    }
+}
+
+// The map from the URL param if present, otherwise a random one, -1 for the demo grid
+function pickMap(index: number, mapCount: number): number {
+    if (!isNaN(mapIndex) && mapIndex >= 0 && mapIndex < mapCount) {
+        return mapIndex;
+    }
+    console.log("Map id not found in URL, loading random map");
+    if (mapCount === 0) return -1;
+    const randomMapIndex = Math.floor(Math.random() * mapCount);
+    console.log(`Simulation ${index}: Loading map ${randomMapIndex} of ${mapCount}`);
+    return randomMapIndex;
+}
+
+// Reads the metrics from the engine, or from the snapshot the renderer showed last
+function readMetrics(simulation: Simulation): boolean {
+    let snapshot: EngineMetrics;
+    if (simulation.engine) {
+        snapshot = simulation.engine.source.metrics();
+    } else {
+        simulation.wasm!.select_context(simulation.context);
+        snapshot = readEngineMetrics(simulation.wasm!);
+    }
+    setMetrics(simulation, snapshot);
+    return snapshot.complete;
+}
+
+function setMetrics(simulation: Simulation, snapshot: EngineMetrics): void {
+    const metrics = simulation.metrics;
+    metrics.steps = snapshot.steps;
+    metrics.robots = snapshot.robots;
+    metrics.makespan = snapshot.makespan;
+    metrics.t_total = snapshot.t_total;
+    metrics.t_max = snapshot.t_max;
+    metrics.e_total = snapshot.e_total;
+    metrics.e_max = snapshot.e_max;
+}
+
+function showMetrics(simulation: Simulation): void {
+    updateSimulationStats(simulation);
+    // Live update globalStats for this simulation index
+    setGlobalMetrics(simulation.index, simulation.metrics);
+    updateGlobalStats();
+}
+
 function startSimulation(simulation: Simulation): void {
     if (simulation.running) return;
     simulation.running = true;
     simulation.lastStepTime = performance.now();
+    const engine = simulation.engine;
+    if (engine) {
+        // The worker keeps the step pace, the frames only show its latest snapshot
+        engine.start(simulation.stepInterval);
+        function workerLoop(): void {
+            if (!simulation.running) return;
+            simulation.gridRenderer.updateGrid();
+            const complete = readMetrics(simulation);
+            showMetrics(simulation);
+            if (complete) {
+                stopSimulation(simulation);
+                return;
+            }
+            simulation.animFrameId = requestAnimationFrame(workerLoop);
+        }
+        simulation.animFrameId = requestAnimationFrame(workerLoop);
+        return;
+    }
+    const wasm = simulation.wasm!;
     function simulationLoop(now: number): void {
         if (!simulation.running) return;
         if (now - simulation.lastStepTime >= simulation.stepInterval) {
-            simulation.wasm.simulate_step();
-            simulation.gridRenderer.renderGrid();
-            // Update metrics
-            simulation.metrics.steps = simulation.wasm.get_simulation_steps();
-            simulation.metrics.robots = simulation.wasm.get_robot_count ? simulation.wasm.get_robot_count() : 0;
-            simulation.metrics.makespan = simulation.wasm.get_makespan ? simulation.wasm.get_makespan() : 0;
-            simulation.metrics.t_total = simulation.wasm.get_t_total ? simulation.wasm.get_t_total() : 0;
-            simulation.metrics.t_max = simulation.wasm.get_t_max ? simulation.wasm.get_t_max() : 0;
-            simulation.metrics.e_total = simulation.wasm.get_e_total ? simulation.wasm.get_e_total() : 0;
-            simulation.metrics.e_max = simulation.wasm.get_e_max ? simulation.wasm.get_e_max() : 0;
-            updateSimulationStats(simulation);
-            // Live update globalStats for this simulation index
-            globalStats.steps[simulation.index] = simulation.metrics.steps;
-            globalStats.makespans[simulation.index] = simulation.metrics.makespan;
-            globalStats.tTotals[simulation.index] = simulation.metrics.t_total;
-            globalStats.tMaxs[simulation.index] = simulation.metrics.t_max;
-            globalStats.eTotals[simulation.index] = simulation.metrics.e_total;
-            globalStats.eMaxs[simulation.index] = simulation.metrics.e_max;
-            updateGlobalStats();
-            simulation.lastStepTime = now;
+            // Every step that is due since the last frame in one call
+            const due = Math.min(MAX_STEPS_PER_FRAME, Math.floor((now - simulation.lastStepTime) / simulation.stepInterval));
+            wasm.select_context(simulation.context);
+            wasm.simulate_steps(due);
+            simulation.gridRenderer.updateGrid();
+            const complete = readMetrics(simulation);
+            showMetrics(simulation);
+            // Drop the backlog when a frame could not catch up
+            simulation.lastStepTime = due < MAX_STEPS_PER_FRAME ? simulation.lastStepTime + due * simulation.stepInterval : now;
             // Check if simulation is complete
-            if (simulation.wasm.is_simulation_complete && simulation.wasm.is_simulation_complete()) {
+            if (complete) {
                 stopSimulation(simulation);
                 return;
             }
@@ -335,6 +459,7 @@ function startSimulation(simulation: Simulation): void {
 
 function stopSimulation(simulation: Simulation): void {
     simulation.running = false;
+    simulation.engine?.stop();
     if (simulation.animFrameId) {
         cancelAnimationFrame(simulation.animFrameId);
         simulation.animFrameId = null;
@@ -344,29 +469,36 @@ function stopSimulation(simulation: Simulation): void {
 function resetSimulation(simulation: Simulation): void {
     stopSimulation(simulation);
     
-    if (simulation.wasm.reset_simulation) {
-        simulation.wasm.reset_simulation();
+    if (simulation.engine) {
+        // The renderer reads the reset state once the worker published it
+        simulation.engine.reset().then(() => {
+            simulation.gridRenderer.renderGrid();
+            readMetrics(simulation);
+            updateSimulationStats(simulation);
+        }).catch(error => {
+            console.error(`Error resetting simulation ${simulation.index}:`, error);
+        });
     } else {
-        // Fallback to loading a random map
-        const mapCount = simulation.wasm.get_map_count();
-        if (mapCount > 0) {
-            const randomMapIndex = Math.floor(Math.random() * mapCount);
-            simulation.wasm.load_map(randomMapIndex);
+        const wasm = simulation.wasm!;
+        wasm.select_context(simulation.context);
+        if (wasm.reset_simulation) {
+            wasm.reset_simulation();
         } else {
-            simulation.wasm.create_demo_grid();
+            // Fallback to loading a random map
+            const mapCount = wasm.get_map_count();
+            if (mapCount > 0) {
+                const randomMapIndex = Math.floor(Math.random() * mapCount);
+                wasm.load_map(randomMapIndex);
+            } else {
+                wasm.create_demo_grid();
+            }
         }
+        simulation.gridRenderer.renderGrid();
+        simulation.metrics.steps = 0;
+        simulation.metrics.robots = wasm.get_robot_count ? wasm.get_robot_count() : 0;
     }
-    
-    simulation.gridRenderer.renderGrid();
-    simulation.metrics.steps = 0;
-    simulation.metrics.robots = simulation.wasm.get_robot_count ? simulation.wasm.get_robot_count() : 0;
     // Reset this simulation's stats in globalStats
-    globalStats.steps[simulation.index] = NaN;
-    globalStats.makespans[simulation.index] = NaN;
-    globalStats.tTotals[simulation.index] = NaN;
-    globalStats.tMaxs[simulation.index] = NaN;
-    globalStats.eTotals[simulation.index] = NaN;
-    globalStats.eMaxs[simulation.index] = NaN;
+    setGlobalMetrics(simulation.index, null);
     updateGlobalStats();
     updateSimulationStats(simulation);
 }
@@ -395,122 +527,173 @@ function updateSimulationStats(simulation: Simulation): void {
     }
 }
 
-function addToGlobalStats(metrics: SimulationMetrics, index?: number): void {
-    // Deprecated: now handled live in simulation loop
+// Sets the metrics of a slot of the global statistics, null empties the slot
+function setGlobalMetrics(slot: number, metrics: SimulationMetrics | null): void {
+    globalStats.makespan.set(slot, metrics ? metrics.makespan : NaN);
+    globalStats.ttotal.set(slot, metrics ? metrics.t_total : NaN);
+    globalStats.tmax.set(slot, metrics ? metrics.t_max : NaN);
+    globalStats.etotal.set(slot, metrics ? metrics.e_total : NaN);
+    globalStats.emax.set(slot, metrics ? metrics.e_max : NaN);
 }
 
-function calcStats(arr: number[]) {
-    if (arr.length === 0) return { min: NaN, max: NaN, avg: NaN, var: NaN };
-    const min = Math.min(...arr);
-    const max = Math.max(...arr);
-    const avg = arr.reduce((a, b) => a + b, 0) / arr.length;
-    const variance = arr.length > 1 ? arr.reduce((a, b) => a + Math.pow(b - avg, 2), 0) / arr.length : 0;
-    return { min, max, avg, var: variance };
+// Draws the global statistics on the next animation frame, at most once per frame
+// however many simulations changed
+function updateGlobalStats(): void {
+    if (globalStatsFrame !== null) return;
+    globalStatsFrame = requestAnimationFrame(() => {
+        globalStatsFrame = null;
+        drawGlobalStats();
+    });
 }
 
-function updateGlobalStats() {
-    // Only use finite values for stats
-    const valid = (arr: number[]) => arr.filter(x => isFinite(x));
-    const stepsStats = calcStats(valid(globalStats.steps));
-    globalStats.minSteps = stepsStats.min;
-    globalStats.maxSteps = stepsStats.max;
-    globalStats.avgSteps = stepsStats.avg;
-    globalStats.variance = stepsStats.var;
-    const makespanStats = calcStats(valid(globalStats.makespans));
-    globalStats.minMakespan = makespanStats.min;
-    globalStats.maxMakespan = makespanStats.max;
-    globalStats.avgMakespan = makespanStats.avg;
-    globalStats.varMakespan = makespanStats.var;
-    const tTotalStats = calcStats(valid(globalStats.tTotals));
-    globalStats.minTTotal = tTotalStats.min;
-    globalStats.maxTTotal = tTotalStats.max;
-    globalStats.avgTTotal = tTotalStats.avg;
-    globalStats.varTTotal = tTotalStats.var;
-    const tMaxStats = calcStats(valid(globalStats.tMaxs));
-    globalStats.minTMax = tMaxStats.min;
-    globalStats.maxTMax = tMaxStats.max;
-    globalStats.avgTMax = tMaxStats.avg;
-    globalStats.varTMax = tMaxStats.var;
-    const eTotalStats = calcStats(valid(globalStats.eTotals));
-    globalStats.minETotal = eTotalStats.min;
-    globalStats.maxETotal = eTotalStats.max;
-    globalStats.avgETotal = eTotalStats.avg;
-    globalStats.varETotal = eTotalStats.var;
-    const eMaxStats = calcStats(valid(globalStats.eMaxs));
-    globalStats.minEMax = eMaxStats.min;
-    globalStats.maxEMax = eMaxStats.max;
-    globalStats.avgEMax = eMaxStats.avg;
-    globalStats.varEMax = eMaxStats.var;
+function drawGlobalStats(): void {
+    if (!globalStatsElements) {
+        const get = (id: string) => document.getElementById(id);
+        const elements = {} as Record<GlobalMetric, SummaryElements>;
+        for (const metric of GLOBAL_METRICS) {
+            elements[metric] = {
+                max: get(`global-max-${metric}`),
+                min: get(`global-min-${metric}`),
+                avg: get(`global-avg-${metric}`),
+                var: get(`global-var-${metric}`)
+            };
+        }
+        globalStatsElements = elements;
+    }
     // Update UI for new compact Unicode format
-    const set = (id: string, value: number) => {
-        const el = document.getElementById(id);
-        if (el) el.textContent = isFinite(value) ? value.toFixed(id.includes('avg') || id.includes('var') ? 1 : 0) : '-';
+    const set = (el: HTMLElement | null, value: number, digits: number) => {
+        const text = isFinite(value) ? value.toFixed(digits) : '-';
+        if (el && el.textContent !== text) el.textContent = text;
     };
-    set('global-max-makespan', globalStats.maxMakespan);
-    set('global-min-makespan', globalStats.minMakespan);
-    set('global-avg-makespan', globalStats.avgMakespan);
-    set('global-var-makespan', globalStats.varMakespan);
-    set('global-max-ttotal', globalStats.maxTTotal);
-    set('global-min-ttotal', globalStats.minTTotal);
-    set('global-avg-ttotal', globalStats.avgTTotal);
-    set('global-var-ttotal', globalStats.varTTotal);
-    set('global-max-tmax', globalStats.maxTMax);
-    set('global-min-tmax', globalStats.minTMax);
-    set('global-avg-tmax', globalStats.avgTMax);
-    set('global-var-tmax', globalStats.varTMax);
-    set('global-max-etotal', globalStats.maxETotal);
-    set('global-min-etotal', globalStats.minETotal);
-    set('global-avg-etotal', globalStats.avgETotal);
-    set('global-var-etotal', globalStats.varETotal);
-    set('global-max-emax', globalStats.maxEMax);
-    set('global-min-emax', globalStats.minEMax);
-    set('global-avg-emax', globalStats.avgEMax);
-    set('global-var-emax', globalStats.varEMax);
+    for (const metric of GLOBAL_METRICS) {
+        const summary = globalStats[metric];
+        const elements = globalStatsElements[metric];
+        set(elements.max, summary.max(), 0);
+        set(elements.min, summary.min(), 0);
+        set(elements.avg, summary.mean(), 1);
+        set(elements.var, summary.variance(), 1);
+    }
+}
+
+// Runs one replicate on a simulation, in its worker or in slices on the main thread
+async function runReplicate(simulation: Simulation, replicate: number): Promise<EngineMetrics> {
+    if (simulation.engine) {
+        return simulation.engine.run(pickMap(replicate, simulation.engine.mapCount), defaultPValue);
+    }
+    const wasm = simulation.wasm!;
+    wasm.select_context(simulation.context);
+    loadSimulationMap(wasm, replicate);
+    for (;;) {
+        wasm.select_context(simulation.context);
+        wasm.simulate_steps(COMPUTE_SLICE_STEPS);
+        if (wasm.is_simulation_complete()) break;
+        // Let the page and the other simulations run
+        await new Promise(resolve => setTimeout(resolve, 0));
+    }
+    return readEngineMetrics(wasm);
+}
+
+// Runs `replicates` simulations as fast as possible and only refreshes the global
+// statistics and the first COMPUTE_SAMPLED_VIEWS views while they run
+async function computeAll(replicates: number, progress: HTMLElement | null): Promise<void> {
+    simulations.forEach(sim => stopSimulation(sim));
+    clearGlobalStats(replicates);
+    computing = true;
+    computeResults = true;
+
+    let next = 0;
+    let finished = 0;
+    const sampled = simulations.slice(0, COMPUTE_SAMPLED_VIEWS);
+    const refresh = (): void => {
+        updateGlobalStats();
+        sampled.forEach(sim => {
+            sim.gridRenderer.updateGrid();
+            updateSimulationStats(sim);
+        });
+        if (progress) progress.textContent = `${finished} / ${replicates}`;
+    };
+    let lastRefresh = 0;
+    function refreshLoop(now: number): void {
+        if (!computing) return;
+        if (now - lastRefresh >= COMPUTE_REFRESH_MS) {
+            refresh();
+            lastRefresh = now;
+        }
+        requestAnimationFrame(refreshLoop);
+    }
+    requestAnimationFrame(refreshLoop);
+
+    // Every simulation takes the next replicate when it is done with one
+    await Promise.all(simulations.map(async sim => {
+        while (next < replicates) {
+            const replicate = next++;
+            let metrics: EngineMetrics;
+            try {
+                metrics = await runReplicate(sim, replicate);
+            } catch (error) {
+                // The other simulations stop at their next replicate
+                next = replicates;
+                throw error;
+            }
+            setGlobalMetrics(replicate, metrics);
+            setMetrics(sim, metrics);
+            finished++;
+        }
+    }));
+
+    computing = false;
+    refresh();
+    simulations.forEach(sim => {
+        sim.gridRenderer.updateGrid();
+        updateSimulationStats(sim);
+    });
+}
+
+// Clears the statistics, with room for `size` results
+function clearGlobalStats(size: number): void {
+    computeResults = false;
+    for (const metric of GLOBAL_METRICS) {
+        globalStats[metric].clear(size);
+    }
 }
 
 function setupGlobalControls() {
     const startAllBtn = document.getElementById('start-all') as HTMLButtonElement;
     const resetAllBtn = document.getElementById('reset-all') as HTMLButtonElement;
+    const computeBtn = document.getElementById('compute-all') as HTMLButtonElement;
+    const replicatesInput = document.getElementById('compute-replicates') as HTMLInputElement;
+    const progress = document.getElementById('compute-progress');
     startAllBtn.addEventListener('click', () => {
+        if (computing) return;
+        // The live views write their slots, they must not mix with the replicates of a compute
+        if (computeResults) {
+            clearGlobalStats(NUM_SIMULATIONS);
+            updateGlobalStats();
+        }
         simulations.forEach(sim => {
             startSimulation(sim);
         });
     });
     resetAllBtn.addEventListener('click', () => {
+        if (computing) return;
         simulations.forEach(sim => {
             resetSimulation(sim);
         });
         // Reset global statistics
-        globalStats.steps.fill(NaN);
-        globalStats.makespans.fill(NaN);
-        globalStats.tTotals.fill(NaN);
-        globalStats.tMaxs.fill(NaN);
-        globalStats.eTotals.fill(NaN);
-        globalStats.eMaxs.fill(NaN);
-        globalStats.minSteps = Infinity;
-        globalStats.maxSteps = 0;
-        globalStats.avgSteps = 0;
-        globalStats.variance = 0;
-        globalStats.minMakespan = Infinity;
-        globalStats.maxMakespan = 0;
-        globalStats.avgMakespan = 0;
-        globalStats.varMakespan = 0;
-        globalStats.minTTotal = Infinity;
-        globalStats.maxTTotal = 0;
-        globalStats.avgTTotal = 0;
-        globalStats.varTTotal = 0;
-        globalStats.minTMax = Infinity;
-        globalStats.maxTMax = 0;
-        globalStats.avgTMax = 0;
-        globalStats.varTMax = 0;
-        globalStats.minETotal = Infinity;
-        globalStats.maxETotal = 0;
-        globalStats.avgETotal = 0;
-        globalStats.varETotal = 0;
-        globalStats.minEMax = Infinity;
-        globalStats.maxEMax = 0;
-        globalStats.avgEMax = 0;
-        globalStats.varEMax = 0;
+        clearGlobalStats(NUM_SIMULATIONS);
         updateGlobalStats();
     });
+    computeBtn.addEventListener('click', async () => {
+        if (computing || simulations.length === 0) return;
+        const replicates = Math.max(1, parseInt(replicatesInput.value, 10) || 1);
+        startAllBtn.disabled = resetAllBtn.disabled = computeBtn.disabled = true;
+        try {
+            await computeAll(replicates, progress);
+        } catch (error) {
+            console.error("Error computing replicates:", error);
+        } finally {
+            computing = false;
+            startAllBtn.disabled = resetAllBtn.disabled = computeBtn.disabled = false;
+        }
+    });
 }
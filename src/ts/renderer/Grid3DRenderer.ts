@@ -1,9 +1,20 @@
 import * as THREE from 'three';
 import { OrbitControls } from 'three/examples/jsm/controls/OrbitControls.js';
-import { CellType, WasmExports } from '../types.js';
+import { CellType } from '../types.js';
+import { GridSource } from './GridSource.js';
+import { InstancePool } from './InstancePool.js';
+
+const CELL_TYPES = 8; // Render codes fit in 3 bits
+const NOT_STATIC = 0xff;
+const STATIC_CELL = -2; // cellInstance of a wall or door cell, like the engine writes it
+const MIN_OPACITY = 0.01; // Cells at or below it are not instanced
+
+function isStatic(type: CellType): boolean {
+    return type === CellType.WALL || type === CellType.DOOR;
+}
 
 export class Grid3DRenderer {
-    private wasm: WasmExports;
+    private source: GridSource;
     private container: HTMLElement;
     private crosshair: HTMLElement;
     private scene: THREE.Scene;
@@ -17,15 +28,27 @@ export class Grid3DRenderer {
     private cameraDefaultPosition = new THREE.Vector3(20, 20, 20);
     private cameraDefaultTarget = new THREE.Vector3(0, 0, 0);
 
-    private geometry: THREE.BoxGeometry | null = null;
     private material: THREE.MeshStandardMaterial | null = null;
-    private mesh: THREE.InstancedMesh | null = null;
-    private dummy: THREE.Object3D = new THREE.Object3D();
-    private color: THREE.Color = new THREE.Color();
-    // Removed lastVisibleCount, will compare mesh.count directly
-
-    constructor(wasm: WasmExports, container: HTMLElement, crosshair: HTMLElement) {
-        this.wasm = wasm;
+    private colorTable = new Float32Array(CELL_TYPES * 3);
+    private opacityTable = new Float32Array(CELL_TYPES);
+
+    // Walls and doors never change during a simulation, they are drawn by their
+    // own mesh that is only rebuilt when the layout or an opacity changes
+    private staticPool: InstancePool | null = null;
+    private staticCells: Uint8Array = new Uint8Array(0); // Wall or door code of every cell, NOT_STATIC otherwise
+    private staticDirty = true;
+    // Every other visible cell, patched by updateGrid with the dirty cells of the engine
+    private cellPool: InstancePool | null = null;
+    private incremental = false;
+    private cellInstance: Int32Array = new Int32Array(0); // Instance of every cell, -1 if it is not drawn
+    private gridSize = { x: 0, y: 0, z: 0 };
+    // Buffers the engine filled in its memory, if the source lets it (see renderEngineInstances)
+    private layoutVersion = -1;
+    private instanceMemory: ArrayBufferLike | null = null;
+    private sceneSize = ''; // Grid size the lights and helpers were placed for
+
+    constructor(source: GridSource, container: HTMLElement, crosshair: HTMLElement) {
+        this.source = source;
         this.container = container;
         this.crosshair = crosshair;
         this.scene = new THREE.Scene();
@@ -55,11 +78,21 @@ export class Grid3DRenderer {
         this.materialOpacities.set(CellType.SETTLED_ROBOT, 1);
         this.materialOpacities.set(CellType.DOOR, 1);
         this.materialOpacities.set(CellType.SLEEPING_ROBOT, 1);
+        this.updateTables();
     }
 
-    // Setup geometry, material (with shader mods), and initial mesh
+    // Colors and opacities by cell type, read by the instance pools
+    private updateTables() {
+        const color = new THREE.Color();
+        for (let type = 0; type < CELL_TYPES; type++) {
+            color.set(this.getCellColor(type as CellType));
+            color.toArray(this.colorTable, type * 3);
+            this.opacityTable[type] = this.materialOpacities.get(type as CellType) ?? 1;
+        }
+    }
+
+    // Setup material (with shader mods) and the instance pools
     private setupInstancedMesh() {
-        this.geometry = new THREE.BoxGeometry(1, 1, 1);
         this.material = new THREE.MeshStandardMaterial({
             // vertexColors: false, // Using instance colors via shader
             transparent: true,    // Required for opacity < 1
@@ -127,15 +160,16 @@ export class Grid3DRenderer {
             );
         };
 
-        // Create mesh with initial count 0, will be updated in renderGrid
-        this.mesh = new THREE.InstancedMesh(this.geometry, this.material, 0);
-        this.mesh.name = "gridCells"; // Name for easier debugging/removal
-        this.scene.add(this.mesh);
+        // Meshes are created by the pools on the first render, names for easier debugging
+        this.staticPool = new InstancePool(this.scene, this.material, "gridStaticCells", this.colorTable, this.opacityTable);
+        this.cellPool = new InstancePool(this.scene, this.material, "gridCells", this.colorTable, this.opacityTable);
     }
 
 
     public setMaterialOpacity(type: CellType, opacity: number) {
         this.materialOpacities.set(type, opacity);
+        this.updateTables();
+        this.staticDirty = true;
         this.renderGrid(); // Re-render when opacity changes
     }
 
@@ -149,107 +183,150 @@ export class Grid3DRenderer {
     }
 
     public renderGrid() {
+        if (!this.staticPool || !this.cellPool) {
+            console.error("Instance pools not initialized!");
+            return;
+        }
+        if (this.renderEngineInstances()) return;
+
+        // Read the cells first, the sizes below belong to the same snapshot
+        const cells = this.source.readCells();
         // Get grid size
-        const sizeX = this.wasm.get_grid_size_x();
-        const sizeY = this.wasm.get_grid_size_y();
-        const sizeZ = this.wasm.get_grid_size_z();
-        // Compute centering offsets
-        const offsetX = (sizeX - 1) / 2;
-        const offsetY = 0; // Assuming base is at y=0
-        const offsetZ = (sizeZ - 1) / 2;
+        const sizeX = this.source.sizeX();
+        const sizeY = this.source.sizeY();
+        const sizeZ = this.source.sizeZ();
+        const cellCount = sizeX * sizeY * sizeZ;
+        this.gridSize = { x: sizeX, y: sizeY, z: sizeZ };
+        this.setupSceneHelpers();
+
+        if (this.cellInstance.length !== cellCount) {
+            this.cellInstance = new Int32Array(cellCount);
+            this.staticCells = new Uint8Array(cellCount).fill(NOT_STATIC);
+            this.staticDirty = true;
+        }
 
-        // Collect data for visible cells
-        const cellData: { x: number, y: number, z: number, type: CellType }[] = [];
+        // Every visible cell that is not a wall or door, walls and doors are only
+        // compared with the last render
+        const pool = this.cellPool;
+        const staticCells = this.staticCells;
+        const cellInstance = this.cellInstance;
+        const opacities = this.opacityTable;
+        pool.clear();
+        let cell = 0;
         for (let x = 0; x < sizeX; x++) {
             for (let y = 0; y < sizeY; y++) {
-                for (let z = 0; z < sizeZ; z++) {
-                    const cellType = this.wasm.get_cell(x, y, z);
-                    const opacity = this.materialOpacities.get(cellType) ?? 1;
-                    // Only instance cells that are not fully transparent (use a small threshold)
-                    if (opacity > 0.01) {
-                         cellData.push({ x, y, z, type: cellType });
+                for (let z = 0; z < sizeZ; z++, cell++) {
+                    const cellType = cells ? cells[cell] as CellType : this.source.getCell(x, y, z);
+                    cellInstance[cell] = -1;
+                    if (isStatic(cellType)) {
+                        cellInstance[cell] = STATIC_CELL;
+                        if (staticCells[cell] !== cellType) {
+                            staticCells[cell] = cellType;
+                            this.staticDirty = true;
+                        }
+                        continue;
+                    }
+                    if (staticCells[cell] !== NOT_STATIC) {
+                        staticCells[cell] = NOT_STATIC;
+                        this.staticDirty = true;
+                    }
+                    // Only instance cells that are not fully transparent
+                    if (opacities[cellType] > MIN_OPACITY) {
+                        cellInstance[cell] = this.addInstance(pool, cell, cellType);
                     }
                 }
             }
         }
-        const visibleCount = cellData.length;
+        pool.upload();
+        if (this.staticDirty) this.renderStaticCells();
 
-        // Ensure mesh exists and has the correct size
-        // Dispose old mesh resources ONLY if count changes drastically or becomes 0?
-        // For simplicity, let's just update the count and attributes if mesh exists
-        if (!this.mesh || !this.geometry || !this.material) {
-            console.error("Mesh, geometry or material not initialized!");
-            return;
-        }
+        // The following steps can be patched if the source knows the changes
+        this.incremental = cells !== null;
+        // Rendering is handled by the animate loop
+    }
 
-        // Check if mesh needs resizing (more instances needed than allocated)
-        if (visibleCount > this.mesh.count) {
-             // Recreate mesh if needed (can be expensive)
-             this.scene.remove(this.mesh);
-             this.mesh.dispose(); // Dispose old instance data
-             this.mesh = new THREE.InstancedMesh(this.geometry, this.material, visibleCount);
-             this.mesh.name = "gridCells";
-             this.scene.add(this.mesh);
-             // Force attribute recreation below
-             this.geometry.deleteAttribute('instanceColor');
-             this.geometry.deleteAttribute('instanceOpacity');
+    // Lets the engine write the instances into its memory, the pools draw them
+    // from there without a loop over the cells in JS. False if the source cannot.
+    private renderEngineInstances(): boolean {
+        const source = this.source;
+        if (!source.readInstances || !source.layoutVersion) return false;
+        const cells = source.readInstances(0, this.visibleCodes(false), this.colorTable, this.opacityTable);
+        if (!cells || !cells.cellInstances) return false;
+
+        this.gridSize = { x: source.sizeX(), y: source.sizeY(), z: source.sizeZ() };
+        this.setupSceneHelpers();
+        this.cellPool!.bind(cells, cells.count);
+        this.cellPool!.upload();
+        this.cellInstance = cells.cellInstances;
+        this.incremental = true;
+
+        // A grown memory moved the buffers, the walls are bound again too
+        const layoutVersion = source.layoutVersion();
+        if (this.staticDirty || layoutVersion !== this.layoutVersion || cells.matrices.buffer !== this.instanceMemory) {
+            const walls = source.readInstances(1, this.visibleCodes(true), this.colorTable, this.opacityTable)!;
+            this.staticPool!.bind(walls, walls.count);
+            this.staticPool!.upload();
+            this.layoutVersion = layoutVersion;
+            this.instanceMemory = cells.matrices.buffer;
+            this.staticDirty = false;
         }
-        // Update the number of instances to draw
-        this.mesh.count = visibleCount;
-
-
-        // Prepare attribute arrays
-        const matrix = new THREE.Matrix4();
-        const colorArray = new Float32Array(visibleCount * 3);
-        const opacityArray = new Float32Array(visibleCount);
-
-        // Populate arrays and set instance matrices
-        let i = 0;
-        for (const data of cellData) {
-            const { x, y, z, type } = data;
-
-            // Set transform matrix
-            this.dummy.position.set(x - offsetX, y + 0.5 - offsetY, z - offsetZ); // Center cells vertically
-            this.dummy.updateMatrix();
-            this.mesh.setMatrixAt(i, this.dummy.matrix);
-
-            // Set color attribute data
-            this.color.set(this.getCellColor(type));
-            this.color.toArray(colorArray, i * 3);
-
-            // Set opacity attribute data
-            opacityArray[i] = this.materialOpacities.get(type) ?? 1;
+        return true;
+    }
 
-            i++;
+    // Bit per render code that is drawn, of the walls and doors or of the other cells
+    private visibleCodes(walls: boolean): number {
+        let codes = 0;
+        for (let type = 0; type < CELL_TYPES; type++) {
+            if (isStatic(type) === walls && this.opacityTable[type] > MIN_OPACITY) codes |= 1 << type;
         }
+        return codes;
+    }
 
-        // Update geometry attributes for color
-        const colorAttribute = this.geometry.getAttribute('instanceColor') as THREE.InstancedBufferAttribute | undefined;
-        if (!colorAttribute || colorAttribute.count < visibleCount) {
-             this.geometry.setAttribute('instanceColor', new THREE.InstancedBufferAttribute(colorArray, 3));
-        } else {
-             colorAttribute.copyArray(colorArray);
-             colorAttribute.needsUpdate = true;
+    // Rebuilds the mesh of the walls and doors from the codes of the last render
+    private renderStaticCells() {
+        const pool = this.staticPool!;
+        const staticCells = this.staticCells;
+        pool.clear();
+        for (let cell = 0; cell < staticCells.length; cell++) {
+            const cellType = staticCells[cell];
+            if (cellType !== NOT_STATIC && this.opacityTable[cellType] > MIN_OPACITY) {
+                this.addInstance(pool, cell, cellType);
+            }
         }
+        pool.upload();
+        this.staticDirty = false;
+    }
 
-        // Update geometry attributes for opacity
-        const opacityAttribute = this.geometry.getAttribute('instanceOpacity') as THREE.InstancedBufferAttribute | undefined;
-         if (!opacityAttribute || opacityAttribute.count < visibleCount) {
-             this.geometry.setAttribute('instanceOpacity', new THREE.InstancedBufferAttribute(opacityArray, 1));
-        } else {
-             opacityAttribute.copyArray(opacityArray);
-             opacityAttribute.needsUpdate = true;
-        }
+    private addInstance(pool: InstancePool, cell: number, type: CellType): number {
+        const { x: sizeX, y: sizeY, z: sizeZ } = this.gridSize;
+        const z = cell % sizeZ;
+        const y = Math.floor(cell / sizeZ) % sizeY;
+        const x = Math.floor(cell / (sizeY * sizeZ));
+        // Centered on the x and z axes, cells sit on the base at y=0
+        return pool.add(cell, x - (sizeX - 1) / 2, y + 0.5, z - (sizeZ - 1) / 2, type);
+    }
 
-        // Mark instance matrix attribute for update
-        this.mesh.instanceMatrix.needsUpdate = true;
+    // Lights and helpers are placed relative to the grid, only a new grid size moves them
+    private setupSceneHelpers() {
+        const { x: sizeX, y: sizeY, z: sizeZ } = this.gridSize;
+        const size = `${sizeX}x${sizeY}x${sizeZ}`;
+        if (size === this.sceneSize) return;
+        this.sceneSize = size;
+        const offsetX = (sizeX - 1) / 2;
+        const offsetY = 0; // Assuming base is at y=0
+        const offsetZ = (sizeZ - 1) / 2;
 
-        // --- Scene Setup (Lights, Helpers) ---
         // Remove old lights/helpers if they exist to avoid duplicates
         const objectsToRemove = this.scene.children.filter(obj =>
             obj.type === 'DirectionalLight' || obj.type === 'AmbientLight' || obj.type === 'AxesHelper' || obj.type === 'GridHelper'
         );
-        objectsToRemove.forEach(obj => this.scene.remove(obj));
+        objectsToRemove.forEach(obj => {
+            this.scene.remove(obj);
+            if (obj instanceof THREE.LineSegments) {
+                obj.geometry.dispose();
+                (obj.material as THREE.Material).dispose();
+            }
+        });
 
         // Add lights
         const light = new THREE.DirectionalLight(0xffffff, 1.2); // Slightly brighter light
@@ -267,8 +344,49 @@ export class Grid3DRenderer {
         const gridHelper = new THREE.GridHelper(Math.max(sizeX, sizeZ), Math.max(sizeX, sizeZ));
         gridHelper.position.y = 0; // Align grid helper with the base (y=0)
         this.scene.add(gridHelper);
+    }
 
-        // Rendering is handled by the animate loop
+    // Renders the cells that changed since the last render, the work depends on
+    // how many cells changed and not on the size of the grid. Falls back to
+    // renderGrid when the source does not know the changes (e.g. the engine was
+    // changed outside of simulate_step) or a wall or door changed.
+    public updateGrid() {
+        const { x: sizeX, y: sizeY, z: sizeZ } = this.gridSize;
+        // A grown memory detaches the buffers of the engine
+        if (!this.incremental || !this.cellPool || this.cellInstance.length !== sizeX * sizeY * sizeZ) {
+            this.renderGrid();
+            return;
+        }
+        const known = this.source.readChanges((cell, type) => this.patchCell(cell, type));
+        if (!known) {
+            this.renderGrid();
+            return;
+        }
+        this.cellPool.upload();
+    }
+
+    // Shows a new cell type, adding or removing the instance of the cell when its
+    // visibility changes. Returns false for walls and doors, they are not patched.
+    private patchCell(cell: number, type: CellType): boolean {
+        if (isStatic(type) || this.cellInstance[cell] === STATIC_CELL) return false;
+        const pool = this.cellPool!;
+        const instance = this.cellInstance[cell];
+
+        if (this.opacityTable[type] <= MIN_OPACITY) {
+            if (instance < 0) return true;
+            // The last instance moves into the freed slot
+            const moved = pool.remove(instance);
+            if (moved >= 0) this.cellInstance[moved] = instance;
+            this.cellInstance[cell] = -1;
+            return true;
+        }
+
+        if (instance < 0) {
+            this.cellInstance[cell] = this.addInstance(pool, cell, type);
+        } else {
+            pool.setType(instance, type);
+        }
+        return true;
     }
 
     private getCellColor(cellType: CellType): number {
@@ -313,9 +431,9 @@ export class Grid3DRenderer {
      */
     public setupCameraView(zoomOutFactor: number = 1.8, startOrbiting: boolean = true, orbitSpeed: number = 0.1): void {
         // Get grid size to calculate optimal camera position
-        const sizeX = this.wasm.get_grid_size_x();
-        const sizeY = this.wasm.get_grid_size_y();
-        const sizeZ = this.wasm.get_grid_size_z();
+        const sizeX = this.source.sizeX();
+        const sizeY = this.source.sizeY();
+        const sizeZ = this.source.sizeZ();
         
         // Calculate the diagonal of the grid as a basis for camera distance
         const gridDiagonal = Math.sqrt(sizeX * sizeX + sizeY * sizeY + sizeZ * sizeZ);
@@ -395,13 +513,10 @@ export class Grid3DRenderer {
         window.removeEventListener('resize', this.onWindowResize);
         this.controls.dispose();
 
-        // Remove mesh from scene and dispose its resources
-        if (this.mesh) {
-            this.scene.remove(this.mesh);
-            this.mesh.dispose(); // Disposes instance buffers
-        }
-        // Dispose shared geometry and material
-        if (this.geometry) this.geometry.dispose();
+        // Remove the meshes from the scene and dispose their resources
+        this.staticPool?.dispose();
+        this.cellPool?.dispose();
+        // Dispose shared material
         if (this.material) this.material.dispose();
 
         // Dispose renderer and remove canvas
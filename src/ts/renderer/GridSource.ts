@@ -0,0 +1,134 @@
+import { CellType, WasmExports } from '../types.js';
+import type { PoolBuffers } from './InstancePool.js';
+
+// Instance buffers the engine filled for the renderer (see export_instances),
+// views into its memory that are valid until the memory grows
+export interface GridInstances extends PoolBuffers {
+    count: number;
+    cellInstances: Int32Array | null; // Region 0 instance of every cell, -1 if not drawn, -2 for walls and doors
+}
+
+// Where Grid3DRenderer reads the cells from: the module on the main thread
+// (WasmGridSource) or the snapshots a worker publishes (SharedGridSource).
+// Cells are indexed in x, y, z order with z fastest, like export_cells.
+export interface GridSource {
+    sizeX(): number;
+    sizeY(): number;
+    sizeZ(): number;
+    // Codes of every cell, null if the source can only be read cell by cell. The
+    // view is valid until the next call on the source.
+    readCells(): Uint8Array | null;
+    getCell(x: number, y: number, z: number): CellType;
+    // Calls `patch` with the cells that changed since the last readCells or
+    // readChanges. Returns false if the changes are not known or `patch` refused
+    // one, the caller then has to read every cell again.
+    readChanges(patch: (cell: number, type: CellType) => boolean): boolean;
+    // Optional, lets the engine write the instances of the cells whose code bit is
+    // set in `codes`, colored by the per code tables of the renderer. Region 0 are
+    // the cells that change in a simulation, it also counts as a readCells; region
+    // 1 the walls and the door. Null if the source cannot.
+    readInstances?(region: number, codes: number, colors: Float32Array, opacities: Float32Array): GridInstances | null;
+    // Changes when the walls or the door may have changed
+    layoutVersion?(): number;
+}
+
+export class WasmGridSource implements GridSource {
+    private wasm: WasmExports;
+    private memory: WebAssembly.Memory | null;
+    private context: number;
+    private dirtyRead = 0; // Dirty cell entries already passed to a patch
+
+    // Without the memory the cells are read with one get_cell call each. With a
+    // context id the source selects that engine context before every read.
+    constructor(wasm: WasmExports, memory: WebAssembly.Memory | null = null, context = -1) {
+        this.wasm = wasm;
+        this.memory = memory;
+        this.context = context;
+    }
+
+    private select(): void {
+        if (this.context >= 0) this.wasm.select_context(this.context);
+    }
+
+    sizeX(): number {
+        this.select();
+        return this.wasm.get_grid_size_x();
+    }
+
+    sizeY(): number {
+        this.select();
+        return this.wasm.get_grid_size_y();
+    }
+
+    sizeZ(): number {
+        this.select();
+        return this.wasm.get_grid_size_z();
+    }
+
+    // The view is made after the call, a memory.grow detaches older views
+    readCells(): Uint8Array | null {
+        if (!this.memory || typeof this.wasm.export_cells !== 'function') return null;
+        this.select();
+        const ptr = this.wasm.export_cells();
+        if (typeof this.wasm.get_dirty_cell_head === 'function') {
+            this.dirtyRead = this.wasm.get_dirty_cell_head();
+        }
+        return new Uint8Array(this.memory.buffer, ptr, this.sizeX() * this.sizeY() * this.sizeZ());
+    }
+
+    getCell(x: number, y: number, z: number): CellType {
+        this.select();
+        return this.wasm.get_cell(x, y, z);
+    }
+
+    // The dirty cells simulate_step wrote since the export, unknown if the engine
+    // was changed outside of simulate_step or the reader fell behind the ring
+    readChanges(patch: (cell: number, type: CellType) => boolean): boolean {
+        if (!this.memory || typeof this.wasm.get_dirty_cells !== 'function') return false;
+        this.select();
+        const head = this.wasm.get_dirty_cell_head();
+        const capacity = this.wasm.get_dirty_cell_capacity();
+        const pending = head - this.dirtyRead;
+        if (pending === 0) return true;
+        if (pending < 0 || pending > capacity) return false;
+
+        const entries = new Uint32Array(this.memory.buffer, this.wasm.get_dirty_cells(), capacity);
+        for (let i = this.dirtyRead; i < head; i++) {
+            const entry = entries[i % capacity];
+            if (!patch(entry >>> 3, (entry & 7) as CellType)) return false;
+        }
+        this.dirtyRead = head;
+        return true;
+    }
+
+    // The instance buffers are shared by the engine contexts, so only a source of
+    // the whole module can keep them bound
+    readInstances(region: number, codes: number, colors: Float32Array, opacities: Float32Array): GridInstances | null {
+        const wasm = this.wasm;
+        if (!this.memory || this.context >= 0 || typeof wasm.export_instances !== 'function') return null;
+        for (let code = 0; code < opacities.length; code++) {
+            wasm.set_instance_style(code, colors[code * 3], colors[code * 3 + 1], colors[code * 3 + 2], opacities[code]);
+        }
+        const count = wasm.export_instances(region, codes);
+        if (count < 0) return null; // More cells than the instance buffers hold
+        if (region === 0) this.dirtyRead = wasm.get_dirty_cell_head();
+
+        // The views are made after the export, a memory.grow detaches older views
+        const buffer = this.memory.buffer;
+        const capacity = wasm.get_instance_capacity();
+        const cellCount = wasm.get_grid_size_x() * wasm.get_grid_size_y() * wasm.get_grid_size_z();
+        return {
+            count,
+            matrices: new Float32Array(buffer, wasm.get_instance_matrices(region), capacity * 16),
+            colors: new Float32Array(buffer, wasm.get_instance_colors(region), capacity * 3),
+            opacities: new Float32Array(buffer, wasm.get_instance_opacities(region), capacity),
+            cells: new Int32Array(buffer, wasm.get_instance_cells(region), capacity),
+            cellInstances: region === 0 ? new Int32Array(buffer, wasm.get_cell_instances(), cellCount) : null
+        };
+    }
+
+    layoutVersion(): number {
+        this.select();
+        return this.wasm.get_layout_version();
+    }
+}
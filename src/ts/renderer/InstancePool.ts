@@ -0,0 +1,199 @@
+import * as THREE from 'three';
+
+const MIN_CAPACITY = 256;
+const MATRIX = 16;
+const COLOR = 3;
+
+// Per instance buffers of a pool
+export interface PoolBuffers {
+    matrices: Float32Array;  // 16 floats per instance, column major
+    colors: Float32Array;    // 3 floats per instance
+    opacities: Float32Array;
+    cells: Int32Array;       // Cell shown by every instance
+}
+
+// Instances of one InstancedMesh, allocated with room to spare. The buffers are
+// kept between renders and double when they are full, only then the mesh is
+// created again. Only the instances written since the last upload are sent to
+// the GPU.
+//
+// The instances are unit cubes, their matrices are the identity with a
+// translation.
+export class InstancePool {
+    private scene: THREE.Scene;
+    private material: THREE.Material;
+    private name: string;
+    private colorTable: Float32Array;   // Color of every cell type, 3 floats each
+    private opacityTable: Float32Array; // Opacity of every cell type
+    private geometry: THREE.BoxGeometry | null = null;
+    private mesh: THREE.InstancedMesh | null = null;
+    private matrices = new Float32Array(0);
+    private colors = new Float32Array(0);
+    private opacities = new Float32Array(0);
+    private cells = new Int32Array(0);
+    private capacity = 0;
+    private dirtyStart = 0; // Instances written since the last upload
+    private dirtyEnd = 0;
+    count = 0;
+
+    constructor(scene: THREE.Scene, material: THREE.Material, name: string, colorTable: Float32Array, opacityTable: Float32Array) {
+        this.scene = scene;
+        this.material = material;
+        this.name = name;
+        this.colorTable = colorTable;
+        this.opacityTable = opacityTable;
+    }
+
+    // Makes room for `count` instances, the instances already written are kept
+    reserve(count: number): void {
+        if (count <= this.capacity) return;
+        let capacity = Math.max(MIN_CAPACITY, this.capacity);
+        while (capacity < count) capacity *= 2;
+
+        const buffers = {
+            matrices: new Float32Array(capacity * MATRIX),
+            colors: new Float32Array(capacity * COLOR),
+            opacities: new Float32Array(capacity),
+            cells: new Int32Array(capacity)
+        };
+        buffers.matrices.set(this.matrices.subarray(0, this.count * MATRIX));
+        buffers.colors.set(this.colors.subarray(0, this.count * COLOR));
+        buffers.opacities.set(this.opacities.subarray(0, this.count));
+        buffers.cells.set(this.cells.subarray(0, this.count));
+        this.createMesh(buffers);
+    }
+
+    // Draws `count` instances that were written elsewhere, e.g. by the engine in
+    // its memory, without copying them. The pool keeps writing into the same
+    // buffers, the mesh is only created again when they moved.
+    bind(buffers: PoolBuffers, count: number): void {
+        const bound = this.matrices;
+        if (buffers.matrices.buffer !== bound.buffer || buffers.matrices.byteOffset !== bound.byteOffset) {
+            this.createMesh(buffers);
+        }
+        this.count = count;
+        this.dirtyStart = 0;
+        this.dirtyEnd = count;
+    }
+
+    private createMesh(buffers: PoolBuffers): void {
+        const geometry = new THREE.BoxGeometry(1, 1, 1);
+        const mesh = new THREE.InstancedMesh(geometry, this.material, 0);
+        mesh.instanceMatrix = new THREE.InstancedBufferAttribute(buffers.matrices, MATRIX).setUsage(THREE.DynamicDrawUsage);
+        geometry.setAttribute('instanceColor', new THREE.InstancedBufferAttribute(buffers.colors, COLOR).setUsage(THREE.DynamicDrawUsage));
+        geometry.setAttribute('instanceOpacity', new THREE.InstancedBufferAttribute(buffers.opacities, 1).setUsage(THREE.DynamicDrawUsage));
+        mesh.name = this.name;
+        mesh.count = this.count;
+        // The bounding sphere would be computed once from the first instances
+        mesh.frustumCulled = false;
+
+        this.disposeMesh();
+        this.scene.add(mesh);
+        this.geometry = geometry;
+        this.mesh = mesh;
+        this.matrices = buffers.matrices;
+        this.colors = buffers.colors;
+        this.opacities = buffers.opacities;
+        this.cells = buffers.cells;
+        this.capacity = buffers.cells.length;
+        // New buffers are uploaded whole
+        this.dirtyStart = this.dirtyEnd = 0;
+    }
+
+    // Drops every instance, the buffers are kept for the next ones
+    clear(): void {
+        this.count = 0;
+        this.dirtyStart = this.dirtyEnd = 0;
+    }
+
+    // Appends an instance at the given position, returns its index
+    add(cell: number, x: number, y: number, z: number, type: number): number {
+        const instance = this.count;
+        this.reserve(instance + 1);
+        const matrix = instance * MATRIX;
+        this.matrices.fill(0, matrix, matrix + MATRIX);
+        this.matrices[matrix] = 1;
+        this.matrices[matrix + 5] = 1;
+        this.matrices[matrix + 10] = 1;
+        this.matrices[matrix + 12] = x;
+        this.matrices[matrix + 13] = y;
+        this.matrices[matrix + 14] = z;
+        this.matrices[matrix + 15] = 1;
+        this.cells[instance] = cell;
+        this.count = instance + 1;
+        this.setType(instance, type);
+        return instance;
+    }
+
+    setType(instance: number, type: number): void {
+        const color = instance * COLOR;
+        const entry = type * COLOR;
+        this.colors[color] = this.colorTable[entry];
+        this.colors[color + 1] = this.colorTable[entry + 1];
+        this.colors[color + 2] = this.colorTable[entry + 2];
+        this.opacities[instance] = this.opacityTable[type];
+        this.markDirty(instance);
+    }
+
+    // Removes an instance by moving the last one into its slot. Returns the cell
+    // of the moved instance, -1 if none was moved.
+    remove(instance: number): number {
+        const last = --this.count;
+        if (instance === last) return -1;
+        this.matrices.copyWithin(instance * MATRIX, last * MATRIX, (last + 1) * MATRIX);
+        this.colors.copyWithin(instance * COLOR, last * COLOR, (last + 1) * COLOR);
+        this.opacities[instance] = this.opacities[last];
+        this.cells[instance] = this.cells[last];
+        this.markDirty(instance);
+        return this.cells[instance];
+    }
+
+    private markDirty(instance: number): void {
+        if (this.dirtyStart === this.dirtyEnd) {
+            this.dirtyStart = instance;
+            this.dirtyEnd = instance + 1;
+        } else {
+            this.dirtyStart = Math.min(this.dirtyStart, instance);
+            this.dirtyEnd = Math.max(this.dirtyEnd, instance + 1);
+        }
+    }
+
+    // Sends the written range to the GPU. The ranges are only added, three clears
+    // them once they are uploaded, so several uploads between two frames add up.
+    upload(): void {
+        if (!this.mesh || !this.geometry) return;
+        this.mesh.count = this.count;
+        if (this.dirtyStart === this.dirtyEnd) return;
+        const start = this.dirtyStart;
+        const count = this.dirtyEnd - start;
+        for (const attribute of [
+            this.mesh.instanceMatrix,
+            this.geometry.getAttribute('instanceColor') as THREE.InstancedBufferAttribute,
+            this.geometry.getAttribute('instanceOpacity') as THREE.InstancedBufferAttribute
+        ]) {
+            attribute.addUpdateRange(start * attribute.itemSize, count * attribute.itemSize);
+            attribute.needsUpdate = true;
+        }
+        this.dirtyStart = this.dirtyEnd = 0;
+    }
+
+    private disposeMesh(): void {
+        if (this.mesh) {
+            this.scene.remove(this.mesh);
+            this.mesh.dispose(); // Frees the instance matrix buffer
+        }
+        if (this.geometry) this.geometry.dispose(); // Frees the color and opacity buffers
+        this.mesh = null;
+        this.geometry = null;
+    }
+
+    dispose(): void {
+        this.disposeMesh();
+        this.matrices = new Float32Array(0);
+        this.colors = new Float32Array(0);
+        this.opacities = new Float32Array(0);
+        this.cells = new Int32Array(0);
+        this.capacity = 0;
+        this.count = 0;
+    }
+}
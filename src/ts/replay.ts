@@ -0,0 +1,267 @@
+import { CellType, WasmExports } from './types.js';
+import { memset, memcpy, wasmLoad } from './wasm/utils.js';
+import { Grid3DRenderer } from './renderer/Grid3DRenderer.js';
+import { WasmGridSource } from './renderer/GridSource.js';
+
+// Replay of trajectories recorded by the native CLI (wasm_cli --record <file>).
+// The engine only decodes the recorded steps (trajectory.h), nothing is simulated
+// in the browser. A trajectory is opened from the file picker or from ?file=<url>.
+
+const params = new URLSearchParams(window.location.search);
+const fileParam = params.get('file');
+
+document.addEventListener("DOMContentLoaded", main, false);
+
+interface ReplayElements {
+    file: HTMLInputElement;
+    back: HTMLButtonElement;
+    play: HTMLButtonElement;
+    forward: HTMLButtonElement;
+    slider: HTMLInputElement;
+    step: HTMLElement;
+    speed: HTMLSelectElement;
+}
+
+interface Replay {
+    wasm: WasmExports;
+    memory: WebAssembly.Memory;
+    gridRenderer: Grid3DRenderer;
+    elements: ReplayElements;
+    steps: number;          // Steps of the opened trajectory, -1 if none is open
+    step: number;           // Step shown by the renderer
+    playing: boolean;
+    animFrameId: number | null;
+    lastFrameTime: number;
+    position: number;       // Fractional playback position, in steps
+}
+
+async function main(): Promise<void> {
+    const loadingElement = document.getElementById('loading');
+    const container = document.getElementById('scene');
+
+    try {
+        if (!container) throw new Error('Scene container not found');
+
+        const crosshair = document.createElement('div');
+        crosshair.style.display = 'none'; // No cell editing in the replay
+        container.appendChild(crosshair);
+
+        // Set up memory for WebAssembly, it grows when a large trajectory is opened
+        const memory = new WebAssembly.Memory({ initial: 100, maximum: 1000, shared: false });
+
+        const imports = {
+            env: {
+                console_log: (code: number): void => {
+                    console.log(`WASM: Code ${code}`);
+                },
+                memory: memory,
+                memset: (ptr: number, value: number, size: number): number => {
+                    return memset(ptr, value, size, memory);
+                },
+                memcpy: (dest: number, src: number, len: number): number => {
+                    return memcpy(dest, src, len, memory);
+                },
+                randomInt: (min: number, max: number): number => {
+                    return Math.floor(Math.random() * (max - min + 1)) + min;
+                },
+                // Clock of the step profiler, only used by PROFILE=1 builds
+                profiler_now: (): number => performance.now()
+            },
+        };
+
+        const wasm = await wasmLoad<WasmExports>("main.wasm", imports);
+
+        // Show an empty map until a trajectory is opened
+        if (wasm.get_map_count() > 0) {
+            wasm.load_map(0);
+        }
+
+        const gridRenderer = new Grid3DRenderer(new WasmGridSource(wasm, memory), container, crosshair);
+        gridRenderer.setMaterialOpacity(CellType.WALL, 0);     // 0% (fully transparent)
+        gridRenderer.setMaterialOpacity(CellType.EMPTY, 1);    // 100% (fully visible)
+        gridRenderer.renderGrid();
+        gridRenderer.setupCameraView(1.8, false);
+
+        const replay: Replay = {
+            wasm,
+            memory,
+            gridRenderer,
+            elements: getElements(),
+            steps: -1,
+            step: 0,
+            playing: false,
+            animFrameId: null,
+            lastFrameTime: 0,
+            position: 0
+        };
+        setupControls(replay);
+
+        if (loadingElement && loadingElement.parentNode) {
+            loadingElement.parentNode.removeChild(loadingElement);
+        }
+
+        if (fileParam) {
+            const response = await fetch(fileParam);
+            if (!response.ok) throw new Error(`Failed to load trajectory ${fileParam}: ${response.statusText}`);
+            openTrajectory(replay, await response.arrayBuffer());
+        }
+    } catch (error) {
+        console.error("Error initializing replay:", error);
+        showError(error);
+    }
+}
+
+function getElements(): ReplayElements {
+    const get = <T extends HTMLElement>(id: string): T => {
+        const element = document.getElementById(id);
+        if (!element) throw new Error(`Replay control ${id} not found`);
+        return element as T;
+    };
+    return {
+        file: get<HTMLInputElement>('replay-file'),
+        back: get<HTMLButtonElement>('replay-back'),
+        play: get<HTMLButtonElement>('replay-play'),
+        forward: get<HTMLButtonElement>('replay-forward'),
+        slider: get<HTMLInputElement>('replay-slider'),
+        step: get<HTMLElement>('replay-step'),
+        speed: get<HTMLSelectElement>('replay-speed')
+    };
+}
+
+function showError(error: unknown): void {
+    const errorMessage = error instanceof Error ? error.message : String(error);
+    let errorElement = document.getElementById('loading');
+    if (!errorElement) {
+        errorElement = document.createElement('div');
+        errorElement.id = 'loading';
+        document.getElementById('scene')?.appendChild(errorElement);
+    }
+    errorElement.textContent = `Error: ${errorMessage}`;
+    errorElement.style.color = 'red';
+}
+
+// Copies the file into the trajectory buffer of the engine and shows its first step
+function openTrajectory(replay: Replay, data: ArrayBuffer): void {
+    pause(replay);
+    const { wasm, memory } = replay;
+    const size = data.byteLength;
+
+    // Reserving can grow the memory, which detaches the views created before it
+    const ptr = wasm.trajectory_reserve_buffer(size);
+    if (!ptr) throw new Error(`Not enough memory for a trajectory of ${size} bytes`);
+    new Uint8Array(memory.buffer, ptr, size).set(new Uint8Array(data));
+
+    const steps = wasm.trajectory_open(size);
+    if (steps < 0) {
+        replay.steps = -1;
+        updateControls(replay);
+        throw new Error('The file is not a trajectory recorded by wasm_cli --record');
+    }
+
+    replay.steps = steps;
+    replay.step = 0;
+    replay.position = 0;
+    replay.elements.slider.max = steps.toString();
+    replay.gridRenderer.renderGrid();
+    replay.gridRenderer.setupCameraView(1.8, false);
+    updateControls(replay);
+}
+
+// Shows a step, seeking forward only decodes the steps in between
+function seek(replay: Replay, step: number): void {
+    if (replay.steps < 0) return;
+    step = Math.max(0, Math.min(replay.steps, step));
+    if (step === replay.step) return;
+    if (!replay.wasm.trajectory_seek(step)) {
+        pause(replay);
+        showError(new Error(`The trajectory is corrupt at step ${step}`));
+        return;
+    }
+    replay.step = step;
+    replay.gridRenderer.renderGrid();
+    updateControls(replay);
+}
+
+function updateControls(replay: Replay): void {
+    const { elements, steps, step } = replay;
+    const open = steps >= 0;
+    elements.back.disabled = !open || step === 0;
+    elements.forward.disabled = !open || step === steps;
+    elements.play.disabled = !open;
+    elements.slider.disabled = !open;
+    elements.play.textContent = replay.playing ? 'Pause' : 'Play';
+    elements.slider.value = step.toString();
+    elements.step.textContent = open ? `${step} / ${steps}` : '- / -';
+}
+
+function play(replay: Replay): void {
+    if (replay.playing || replay.steps < 0) return;
+    // Playing at the end starts over
+    if (replay.step === replay.steps) seek(replay, 0);
+    replay.playing = true;
+    replay.position = replay.step;
+    replay.lastFrameTime = performance.now();
+    function replayLoop(now: number): void {
+        if (!replay.playing) return;
+        const stepsPerSecond = parseFloat(replay.elements.speed.value);
+        replay.position += (now - replay.lastFrameTime) / 1000 * stepsPerSecond;
+        replay.lastFrameTime = now;
+        // Fast playback skips steps on screen, the engine still decodes all of them
+        seek(replay, Math.floor(replay.position));
+        if (replay.step === replay.steps) {
+            pause(replay);
+            return;
+        }
+        replay.animFrameId = requestAnimationFrame(replayLoop);
+    }
+    replay.animFrameId = requestAnimationFrame(replayLoop);
+    updateControls(replay);
+}
+
+function pause(replay: Replay): void {
+    replay.playing = false;
+    if (replay.animFrameId) {
+        cancelAnimationFrame(replay.animFrameId);
+        replay.animFrameId = null;
+    }
+    updateControls(replay);
+}
+
+function setupControls(replay: Replay): void {
+    const { elements } = replay;
+
+    elements.file.addEventListener('change', async () => {
+        const file = elements.file.files?.[0];
+        if (!file) return;
+        try {
+            openTrajectory(replay, await file.arrayBuffer());
+        } catch (error) {
+            console.error("Error opening trajectory:", error);
+            showError(error);
+        }
+    });
+
+    elements.play.addEventListener('click', () => {
+        if (replay.playing) {
+            pause(replay);
+        } else {
+            play(replay);
+        }
+    });
+    elements.back.addEventListener('click', () => {
+        pause(replay);
+        seek(replay, replay.step - 1);
+    });
+    elements.forward.addEventListener('click', () => {
+        pause(replay);
+        seek(replay, replay.step + 1);
+    });
+
+    // Scrubbing pauses the playback
+    elements.slider.addEventListener('input', () => {
+        pause(replay);
+        seek(replay, parseInt(elements.slider.value, 10));
+    });
+
+    updateControls(replay);
+}
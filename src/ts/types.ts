@@ -19,13 +19,15 @@ export enum RobotDiff {
     Invalid = 5,
 }
 
+// The 3-bit direction codes of direction.h, in the bits above the RobotDiff of pop_robot_state
 export enum Direction {
     Up = 0,
     Forward = 1,
     Left = 2,
     Down = 3,
     Back = 4,
-    Right = 5
+    Right = 5,
+    None = 7
 }
 
 export const DirectionVectors = {
@@ -37,16 +39,65 @@ export const DirectionVectors = {
     [Direction.Right]: new THREE.Vector3(1, 0, 0)
 };
 
+// Phases and counters of the engine's step profiler (profiler.h). Neighbors and
+// LookCompute are sampled natively only, in wasm Robots holds the whole robot loop
+export enum ProfilePhase {
+    CellStates = 0,
+    Neighbors = 1,
+    LookCompute = 2,
+    Robots = 3,
+    Move = 4,
+    RobotField = 5
+}
+
+export enum ProfileCounter {
+    Activations = 0,
+    SettleChecks = 1,
+    Reachable = 2,
+    Moves = 3,
+    Collisions = 4
+}
+
 export interface RobotState {
     diffState: RobotDiff;
     direction: Direction;
 }
 
+// Split a pop_robot_state value into the diff (low 3 bits) and the direction (next 3 bits)
+export function decodeRobotState(value: number): RobotState {
+    return {
+        diffState: (value & 7) as RobotDiff,
+        direction: ((value >> 3) & 7) as Direction
+    };
+}
+
 export interface WasmExports {
     addone: (arg: number) => number;
     simulate_step: () => void;
+    // Runs up to `count` steps, stops early when the simulation is complete; returns the steps run
+    simulate_steps: (count: number) => number;
     init_grid: (x: number, y: number, z: number) => void;
     get_cell: (x: number, y: number, z: number) => number;
+    // Fills a byte buffer with the get_cell code of every cell (x, y, z order, z fastest), returns its offset in memory
+    export_cells: () => number;
+    // Ring of the cells changed by simulate_step since export_cells, entries are (cell index << 3) | code
+    get_dirty_cells: () => number;
+    get_dirty_cell_capacity: () => number;
+    get_dirty_cell_head: () => number;
+    // Instance buffers of the renderer: region 0 the cells that change in a simulation, region 1
+    // the walls and the door. export_instances writes the cells whose code bit is set in `codes`
+    // and returns the instance count (-1 if the grid does not fit), region 0 also exports the cells
+    // like export_cells.
+    set_instance_style: (code: number, r: number, g: number, b: number, opacity: number) => void;
+    export_instances: (region: number, codes: number) => number;
+    get_instance_capacity: () => number;
+    get_instance_matrices: (region: number) => number;
+    get_instance_colors: (region: number) => number;
+    get_instance_opacities: (region: number) => number;
+    get_instance_cells: (region: number) => number;
+    get_cell_instances: () => number;
+    // Changes when the walls or the door may have changed
+    get_layout_version: () => number;
     set_cell: (x: number, y: number, z: number, value: number) => number;
     get_grid_size_x: () => number;
     get_grid_size_y: () => number;
@@ -64,6 +115,9 @@ export interface WasmExports {
     reset_simulation: () => void;
     create_demo_grid: () => void;
     pop_robot_state: (robot_index: number) => number;
+    // pop_robot_state of every robot in one call, one byte per robot into `out`; returns the robot count
+    pop_all_robot_states: (out: number, max: number) => number;
+    get_robot_state_buffer: () => number;
     load_map: (map_index: number) => void;
     get_map_count: () => number;
     get_map_name_length: (map_index: number) => number;
@@ -72,4 +126,27 @@ export interface WasmExports {
     get_map_size_y: (map_index: number) => number;
     get_map_size_z: (map_index: number) => number;
     set_active_probability: (p: number) => void;
+    set_external_direction: (dir: Direction) => void;
+    run_synchronous: (map_index: number) => number;
+    // Step profiler, see ProfilePhase and ProfileCounter
+    is_profiler_enabled: () => number;
+    reset_profiler: () => void;
+    get_profile_steps: () => number;
+    get_profile_phase_ns: (phase: ProfilePhase) => number;
+    get_profile_total_phase_ns: (phase: ProfilePhase) => number;
+    get_profile_counter: (counter: ProfileCounter) => number;
+    get_profile_total_counter: (counter: ProfileCounter) => number;
+    // Trajectory recording and replay (trajectory.h), the buffer pointers are byte offsets into memory
+    trajectory_start: () => number;
+    trajectory_finish: () => number;
+    get_trajectory_buffer: () => number;
+    trajectory_reserve_buffer: (size: number) => number;
+    trajectory_open: (size: number) => number;
+    trajectory_seek: (step: number) => number;
+    get_trajectory_steps: () => number;
+    // Engine contexts, independent simulations sharing the module and its memory. The
+    // other exports act on the selected context; create_context returns -1 if there is no room
+    create_context: () => number;
+    select_context: (id: number) => boolean;
+    get_context_count: () => number;
 }
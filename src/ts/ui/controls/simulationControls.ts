@@ -62,6 +62,7 @@ export function createSimulationControls(container: HTMLElement, wasm: WasmExpor
     let running = false;
     let lastStepTime = 0;
     let minStepInterval = 200; // ms, default
+    const MAX_STEPS_PER_FRAME = 64;
     
     // Add simulation metrics panel
     const metricsContainer = document.createElement('div');
@@ -151,10 +152,14 @@ export function createSimulationControls(container: HTMLElement, wasm: WasmExpor
     function simulationLoop(now: number) {
         if (!running) return;
         if (now - lastStepTime >= minStepInterval) {
-            wasm.simulate_step();
-            renderer.renderGrid();
+            // Run every step that is due since the last frame in one call, so the
+            // step rate is not limited by the frame rate at high speeds
+            const due = Math.min(MAX_STEPS_PER_FRAME, Math.floor((now - lastStepTime) / minStepInterval));
+            wasm.simulate_steps(due);
+            renderer.updateGrid();
             updateMetrics(); // Update metrics after each step
-            lastStepTime = now;
+            // Drop the backlog when a frame could not catch up
+            lastStepTime = due < MAX_STEPS_PER_FRAME ? lastStepTime + due * minStepInterval : now;
             
             // Check if all robots are settled (simulation complete)
             if (wasm.is_simulation_complete && wasm.is_simulation_complete()) {
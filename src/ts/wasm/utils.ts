@@ -20,6 +20,24 @@ export function memcpy(dest: number, src: number, len: number, memory?: WebAssem
     return dest;
 }
 
+// Compiles the module once, so several instances (or workers) can share it
+export async function wasmCompile(fileName: string): Promise<WebAssembly.Module> {
+    const response = await fetch(fileName);
+    if (!response.ok) {
+        throw new Error(`Failed to load WebAssembly module: ${response.statusText}`);
+    }
+    // Streaming compilation needs the application/wasm content type
+    if (response.headers.get('Content-Type')?.startsWith('application/wasm')) {
+        return WebAssembly.compileStreaming(response);
+    }
+    return WebAssembly.compile(await response.arrayBuffer());
+}
+
+export async function wasmInstantiate<T extends object>(wasmModule: WebAssembly.Module, imports: WebAssembly.Imports): Promise<T> {
+    const instance = await WebAssembly.instantiate(wasmModule, imports);
+    return instance.exports as T;
+}
+
 export async function wasmLoad<T extends object>(fileName: string, imports: WebAssembly.Imports): Promise<T> {
     const response = await fetch(fileName);
     if (!response.ok) {
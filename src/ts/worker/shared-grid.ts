@@ -0,0 +1,273 @@
+// Only type imports, types.js imports three, which the import map of the page
+// does not resolve inside the worker
+import type { CellType, WasmExports } from '../types.js';
+import type { GridSource } from '../renderer/GridSource.js';
+
+// Snapshots of a simulation running in a worker, published through a
+// SharedArrayBuffer with two buffers: the worker writes the one the reader is
+// not using and then makes it the front one. The reader locks the front buffer
+// until its next read, so a snapshot never changes while it is rendered, and it
+// sees every snapshot while it holds a lock.
+//
+// Next to its cells a snapshot carries the dirty cell entries of the engine
+// (get_dirty_cells) since the snapshot before it, so the writer and the reader
+// only touch the changed cells. The cells are copied whole when the entries are
+// not known (a new map, a reset, an overflow).
+//
+//   Int32 header   front buffer index, buffer locked by the reader (-1 none),
+//                  then per buffer: version, grid size (x, y, z), metrics, entry count
+//   entries        per buffer ENTRY_CAPACITY entries, (cell index << 3) | code
+//   cells          per buffer `capacity` render codes, export_cells order
+
+const FRONT = 0;
+const LOCK = 1;
+const GLOBAL_INTS = 2;
+
+// Fields of a buffer header
+const VERSION = 0;
+const SIZE_X = 1;
+const SIZE_Y = 2;
+const SIZE_Z = 3;
+const STEPS = 4;
+const ROBOTS = 5;
+const MAKESPAN = 6;
+const T_TOTAL = 7;
+const T_MAX = 8;
+const E_TOTAL = 9;
+const E_MAX = 10;
+const COMPLETE = 11;
+const ENTRY_COUNT = 12; // -1 if the snapshot has to be read whole
+const BUFFER_INTS = 13;
+
+const ENTRY_CAPACITY = 1 << 14; // Same as the dirty cell ring of the engine
+const ENTRIES_OFFSET = (GLOBAL_INTS + 2 * BUFFER_INTS) * 4;
+const CELLS_OFFSET = ENTRIES_OFFSET + 2 * ENTRY_CAPACITY * 4;
+
+export interface EngineMetrics {
+    steps: number;
+    robots: number;
+    makespan: number;
+    t_total: number;
+    t_max: number;
+    e_total: number;
+    e_max: number;
+    complete: boolean;
+}
+
+export function readEngineMetrics(wasm: WasmExports): EngineMetrics {
+    return {
+        steps: wasm.get_simulation_steps(),
+        robots: wasm.get_robot_count(),
+        makespan: wasm.get_makespan(),
+        t_total: wasm.get_t_total(),
+        t_max: wasm.get_t_max(),
+        e_total: wasm.get_e_total(),
+        e_max: wasm.get_e_max(),
+        complete: wasm.is_simulation_complete()
+    };
+}
+
+export function createSharedGrid(capacity: number): SharedArrayBuffer {
+    const shared = new SharedArrayBuffer(CELLS_OFFSET + 2 * capacity);
+    const header = new Int32Array(shared, 0, GLOBAL_INTS);
+    header[FRONT] = 0;
+    header[LOCK] = -1;
+    return shared;
+}
+
+function cellCapacity(shared: SharedArrayBuffer): number {
+    return (shared.byteLength - CELLS_OFFSET) / 2;
+}
+
+function bufferEntries(shared: SharedArrayBuffer): Uint32Array[] {
+    return [0, 1].map(b => new Uint32Array(shared, ENTRIES_OFFSET + b * ENTRY_CAPACITY * 4, ENTRY_CAPACITY));
+}
+
+// Worker side
+export class SharedGridWriter {
+    private header: Int32Array;
+    private entries: Uint32Array[];
+    private cells: Uint8Array[];
+    private capacity: number;
+    private version = 0;
+    private bufferVersion = [-1, -1]; // Snapshot each buffer holds, -1 none
+    private dirtyRead = -1;         // Dirty cell entries of the engine already published, -1 before the first export
+
+    constructor(shared: SharedArrayBuffer) {
+        this.capacity = cellCapacity(shared);
+        this.header = new Int32Array(shared, 0, GLOBAL_INTS + 2 * BUFFER_INTS);
+        this.entries = bufferEntries(shared);
+        this.cells = [0, 1].map(b => new Uint8Array(shared, CELLS_OFFSET + b * this.capacity, this.capacity));
+    }
+
+    // Writes the current state of the engine into the back buffer and makes it
+    // the front one. Returns false if the reader still holds that buffer, the
+    // state is published on a later call then.
+    publish(wasm: WasmExports, memory: WebAssembly.Memory): boolean {
+        const header = this.header;
+        const front = Atomics.load(header, FRONT);
+        const back = 1 - front;
+        if (Atomics.load(header, LOCK) === back) return false;
+
+        const sizeX = wasm.get_grid_size_x();
+        const sizeY = wasm.get_grid_size_y();
+        const sizeZ = wasm.get_grid_size_z();
+        const count = sizeX * sizeY * sizeZ;
+        if (count > this.capacity) throw new Error(`Grid of ${count} cells does not fit the shared buffer`);
+        const frontBase = GLOBAL_INTS + front * BUFFER_INTS;
+        const base = GLOBAL_INTS + back * BUFFER_INTS;
+
+        // The changes since the front snapshot, unknown after a change outside of
+        // simulate_step (the ring then jumps ahead) or a new grid size
+        const head = wasm.get_dirty_cell_head();
+        const ringCapacity = wasm.get_dirty_cell_capacity();
+        const pending = head - this.dirtyRead;
+        const sameSize = header[frontBase + SIZE_X] === sizeX && header[frontBase + SIZE_Y] === sizeY &&
+            header[frontBase + SIZE_Z] === sizeZ;
+        let entryCount = -1;
+        if (this.dirtyRead >= 0 && this.version > 0 && sameSize && pending >= 0 && pending <= ringCapacity && pending <= ENTRY_CAPACITY) {
+            const ring = new Uint32Array(memory.buffer, wasm.get_dirty_cells(), ringCapacity);
+            const entries = this.entries[back];
+            for (let i = 0; i < pending; i++) entries[i] = ring[(this.dirtyRead + i) % ringCapacity];
+            entryCount = pending;
+            this.dirtyRead = head;
+        }
+
+        const cells = this.cells[back];
+        const frontEntries = header[frontBase + ENTRY_COUNT];
+        if (entryCount >= 0 && frontEntries >= 0 && this.bufferVersion[back] === this.version - 1) {
+            // The back buffer holds the snapshot before the front one
+            this.apply(cells, this.entries[front], frontEntries);
+            this.apply(cells, this.entries[back], entryCount);
+        } else {
+            // Exporting also makes the following dirty entries relative to this state
+            const ptr = wasm.export_cells();
+            this.dirtyRead = wasm.get_dirty_cell_head();
+            cells.set(new Uint8Array(memory.buffer, ptr, count));
+        }
+
+        const metrics = readEngineMetrics(wasm);
+        header[base + VERSION] = ++this.version;
+        header[base + SIZE_X] = sizeX;
+        header[base + SIZE_Y] = sizeY;
+        header[base + SIZE_Z] = sizeZ;
+        header[base + STEPS] = metrics.steps;
+        header[base + ROBOTS] = metrics.robots;
+        header[base + MAKESPAN] = metrics.makespan;
+        header[base + T_TOTAL] = metrics.t_total;
+        header[base + T_MAX] = metrics.t_max;
+        header[base + E_TOTAL] = metrics.e_total;
+        header[base + E_MAX] = metrics.e_max;
+        header[base + COMPLETE] = metrics.complete ? 1 : 0;
+        header[base + ENTRY_COUNT] = entryCount;
+        this.bufferVersion[back] = this.version;
+        // The atomic store orders the writes above before it for the reader
+        Atomics.store(header, FRONT, back);
+        return true;
+    }
+
+    private apply(cells: Uint8Array, entries: Uint32Array, count: number): void {
+        for (let i = 0; i < count; i++) {
+            const entry = entries[i];
+            cells[entry >>> 3] = entry & 7;
+        }
+    }
+}
+
+// Main thread side, the renderer reads the cells straight from the shared memory
+export class SharedGridSource implements GridSource {
+    private header: Int32Array;
+    private entries: Uint32Array[];
+    private cells: Uint8Array[];
+    private held = -1;            // Locked buffer
+    private shownVersion = -1;    // Snapshot of the last read
+
+    constructor(shared: SharedArrayBuffer) {
+        const capacity = cellCapacity(shared);
+        this.header = new Int32Array(shared, 0, GLOBAL_INTS + 2 * BUFFER_INTS);
+        this.entries = bufferEntries(shared);
+        this.cells = [0, 1].map(b => new Uint8Array(shared, CELLS_OFFSET + b * capacity, capacity));
+    }
+
+    // Locks the newest snapshot, the previous one is released for the writer
+    private acquire(): number {
+        for (;;) {
+            const front = Atomics.load(this.header, FRONT);
+            Atomics.store(this.header, LOCK, front);
+            // The writer may have flipped before the lock was visible to it
+            if (Atomics.load(this.header, FRONT) === front) {
+                this.held = front;
+                return front;
+            }
+        }
+    }
+
+    // Lets the writer use both buffers, e.g. while the reader waits for a
+    // request. The next read may skip snapshots, it then reads the cells whole.
+    release(): void {
+        if (this.held < 0) return;
+        Atomics.store(this.header, LOCK, -1);
+        this.held = -1;
+    }
+
+    private field(field: number): number {
+        const buffer = this.held >= 0 ? this.held : this.acquire();
+        return this.header[GLOBAL_INTS + buffer * BUFFER_INTS + field];
+    }
+
+    sizeX(): number {
+        return this.field(SIZE_X);
+    }
+
+    sizeY(): number {
+        return this.field(SIZE_Y);
+    }
+
+    sizeZ(): number {
+        return this.field(SIZE_Z);
+    }
+
+    // A view of the locked buffer, nothing is copied
+    readCells(): Uint8Array {
+        const buffer = this.acquire();
+        const count = this.sizeX() * this.sizeY() * this.sizeZ();
+        this.shownVersion = this.field(VERSION);
+        return this.cells[buffer].subarray(0, count);
+    }
+
+    getCell(x: number, y: number, z: number): CellType {
+        const buffer = this.held >= 0 ? this.held : this.acquire();
+        return this.cells[buffer][(x * this.sizeY() + y) * this.sizeZ() + z] as CellType;
+    }
+
+    // The entries of the newest snapshot, if it follows the one read last
+    readChanges(patch: (cell: number, type: CellType) => boolean): boolean {
+        const buffer = this.acquire();
+        const version = this.field(VERSION);
+        if (version === this.shownVersion) return true;
+        const count = this.field(ENTRY_COUNT);
+        if (version !== this.shownVersion + 1 || count < 0) return false;
+
+        const entries = this.entries[buffer];
+        for (let i = 0; i < count; i++) {
+            const entry = entries[i];
+            if (!patch(entry >>> 3, (entry & 7) as CellType)) return false;
+        }
+        this.shownVersion = version;
+        return true;
+    }
+
+    // Metrics of the snapshot that was read last
+    metrics(): EngineMetrics {
+        return {
+            steps: this.field(STEPS),
+            robots: this.field(ROBOTS),
+            makespan: this.field(MAKESPAN),
+            t_total: this.field(T_TOTAL),
+            t_max: this.field(T_MAX),
+            e_total: this.field(E_TOTAL),
+            e_max: this.field(E_MAX),
+            complete: this.field(COMPLETE) !== 0
+        };
+    }
+}
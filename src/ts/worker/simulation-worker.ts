@@ -0,0 +1,175 @@
+import type { WasmExports } from '../types.js'; // Type only, see shared-grid.ts
+import { memset, memcpy, wasmInstantiate } from '../wasm/utils.js';
+import { createSharedGrid, EngineMetrics, readEngineMetrics, SharedGridWriter } from './shared-grid.js';
+
+// Module worker that owns one engine instance, so slow steps do not block the
+// rendering on the main thread. The state is published to the main thread
+// through a SharedArrayBuffer (shared-grid.ts), see WorkerEngine for the messages.
+
+export type WorkerRequest =
+    | { type: 'init', module: WebAssembly.Module }
+    | { type: 'load', id: number, map: number, p: number }
+    | { type: 'start', stepInterval: number }
+    | { type: 'stop' }
+    | { type: 'reset', id: number }
+    | { type: 'run', id: number, map: number, p: number };
+
+export type WorkerResponse =
+    | { type: 'ready', shared: SharedArrayBuffer, mapCount: number }
+    | { type: 'done', id: number }
+    | { type: 'result', id: number, metrics: EngineMetrics }
+    | { type: 'error', id?: number, message: string }; // id of the failed request, if it has one
+
+const MAX_STEPS_PER_TICK = 256;
+const RETRY_PUBLISH_MS = 4; // The reader holds the back buffer until its next frame
+const SIMULATE_UNTIL_COMPLETE = 0x7fffffff; // Same as in main.cpp
+
+// The DOM lib types `self` as a window
+const scope = self as unknown as {
+    postMessage(message: WorkerResponse): void;
+    onmessage: ((event: MessageEvent<WorkerRequest>) => void) | null;
+};
+
+let wasm: WasmExports | null = null;
+let memory: WebAssembly.Memory | null = null;
+let writer: SharedGridWriter | null = null;
+let running = false;
+let stepInterval = 300;
+let lastStepTime = 0;
+let pending = false; // State that was not published yet
+let waiting: WorkerResponse[] = []; // Answers that are sent once the state is published
+let timer: ReturnType<typeof setTimeout> | null = null;
+
+async function init(wasmModule: WebAssembly.Module): Promise<void> {
+    memory = new WebAssembly.Memory({ initial: 100, maximum: 1000, shared: false });
+    const instanceMemory = memory;
+    const imports = {
+        env: {
+            console_log: (code: number): void => {
+                // Only the step markers, like the multi simulation page
+                if (code === 5001 || code === 5002) console.log(`Worker - Code ${code}`);
+            },
+            memory: instanceMemory,
+            memset: (ptr: number, value: number, size: number): number => {
+                return memset(ptr, value, size, instanceMemory);
+            },
+            memcpy: (dest: number, src: number, len: number): number => {
+                return memcpy(dest, src, len, instanceMemory);
+            },
+            randomInt: (min: number, max: number): number => {
+                return Math.floor(Math.random() * (max - min + 1)) + min;
+            },
+            // Clock of the step profiler, only used by PROFILE=1 builds
+            profiler_now: (): number => performance.now()
+        },
+    };
+    wasm = await wasmInstantiate<WasmExports>(wasmModule, imports);
+
+    // Room for the largest baked in map
+    const mapCount = wasm.get_map_count();
+    let capacity = 1;
+    for (let i = 0; i < mapCount; i++) {
+        capacity = Math.max(capacity, wasm.get_map_size_x(i) * wasm.get_map_size_y(i) * wasm.get_map_size_z(i));
+    }
+    const shared = createSharedGrid(capacity);
+    writer = new SharedGridWriter(shared);
+    scope.postMessage({ type: 'ready', shared, mapCount });
+}
+
+function loadMap(map: number, p: number): void {
+    running = false;
+    wasm!.set_active_probability(p);
+    if (map >= 0) {
+        wasm!.load_map(map);
+    } else {
+        wasm!.create_demo_grid();
+    }
+}
+
+function publish(): void {
+    if (!wasm || !memory || !writer) return;
+    pending = !writer.publish(wasm, memory);
+    if (pending) return;
+    for (const response of waiting) scope.postMessage(response);
+    waiting = [];
+}
+
+// Answers a request after the state it left is published, so the reader finds
+// it on the front buffer
+function publishThen(response: WorkerResponse): void {
+    waiting.push(response);
+    pending = true;
+    publish();
+    if (pending) schedule();
+}
+
+// Runs the steps that are due, then publishes the state if the reader lets it
+function tick(): void {
+    timer = null;
+    if (!wasm) return;
+    if (running) {
+        const now = performance.now();
+        const due = Math.min(MAX_STEPS_PER_TICK, Math.floor((now - lastStepTime) / stepInterval));
+        if (due > 0) {
+            wasm.simulate_steps(due);
+            lastStepTime = due < MAX_STEPS_PER_TICK ? lastStepTime + due * stepInterval : now;
+            pending = true;
+        }
+        if (wasm.is_simulation_complete()) running = false;
+    }
+    if (pending) publish();
+
+    if (running) {
+        const wait = pending ? RETRY_PUBLISH_MS : stepInterval - (performance.now() - lastStepTime);
+        timer = setTimeout(tick, Math.max(0, wait));
+    } else if (pending) {
+        timer = setTimeout(tick, RETRY_PUBLISH_MS);
+    }
+}
+
+function schedule(): void {
+    if (timer !== null) clearTimeout(timer);
+    timer = setTimeout(tick, 0);
+}
+
+scope.onmessage = async (event: MessageEvent<WorkerRequest>) => {
+    const request = event.data;
+    try {
+        switch (request.type) {
+            case 'init':
+                await init(request.module);
+                break;
+            case 'load':
+                if (!wasm) throw new Error('Worker is not initialized');
+                loadMap(request.map, request.p);
+                publishThen({ type: 'done', id: request.id });
+                break;
+            case 'start':
+                if (running) break;
+                running = true;
+                stepInterval = Math.max(0.01, request.stepInterval);
+                lastStepTime = performance.now();
+                schedule();
+                break;
+            case 'stop':
+                running = false;
+                break;
+            case 'reset':
+                if (!wasm) throw new Error('Worker is not initialized');
+                running = false;
+                wasm.reset_simulation();
+                publishThen({ type: 'done', id: request.id });
+                break;
+            case 'run':
+                // One replicate of the compute mode, as fast as possible
+                if (!wasm) throw new Error('Worker is not initialized');
+                loadMap(request.map, request.p);
+                wasm.simulate_steps(SIMULATE_UNTIL_COMPLETE);
+                publishThen({ type: 'result', id: request.id, metrics: readEngineMetrics(wasm) });
+                break;
+        }
+    } catch (error) {
+        const id = 'id' in request ? request.id : undefined;
+        scope.postMessage({ type: 'error', id, message: error instanceof Error ? error.message : String(error) });
+    }
+};
@@ -0,0 +1,105 @@
+import { EngineMetrics, SharedGridSource } from './shared-grid.js';
+import type { WorkerRequest, WorkerResponse } from './simulation-worker.js';
+
+// Main thread handle of an engine in a module worker (simulation-worker.ts).
+// Needs SharedArrayBuffer, so the page has to be cross-origin isolated (served
+// with COOP/COEP headers, see scripts/serve.py).
+export class WorkerEngine {
+    readonly source: SharedGridSource;
+    readonly mapCount: number;
+    private worker: Worker;
+    private nextId = 0;
+    private waiting = new Map<number, { resolve: (response: WorkerResponse) => void, reject: (error: Error) => void }>();
+
+    static isSupported(): boolean {
+        return typeof SharedArrayBuffer !== 'undefined' && (self as { crossOriginIsolated?: boolean }).crossOriginIsolated === true;
+    }
+
+    // The compiled module is shared with the worker, it is not compiled again
+    static create(wasmModule: WebAssembly.Module): Promise<WorkerEngine> {
+        const worker = new Worker(new URL('./simulation-worker.js', import.meta.url), { type: 'module' });
+        return new Promise((resolve, reject) => {
+            worker.onmessage = (event: MessageEvent<WorkerResponse>) => {
+                const response = event.data;
+                if (response.type === 'ready') {
+                    resolve(new WorkerEngine(worker, response.shared, response.mapCount));
+                } else if (response.type === 'error') {
+                    worker.terminate();
+                    reject(new Error(response.message));
+                }
+            };
+            worker.onerror = (event) => reject(new Error(event.message));
+            worker.postMessage({ type: 'init', module: wasmModule } as WorkerRequest);
+        });
+    }
+
+    private constructor(worker: Worker, shared: SharedArrayBuffer, mapCount: number) {
+        this.worker = worker;
+        this.source = new SharedGridSource(shared);
+        this.mapCount = mapCount;
+        worker.onmessage = (event: MessageEvent<WorkerResponse>) => {
+            const response = event.data;
+            if (response.type === 'done' || response.type === 'result') {
+                this.waiting.get(response.id)?.resolve(response);
+                this.waiting.delete(response.id);
+            } else if (response.type === 'error') {
+                console.error(`Simulation worker: ${response.message}`);
+                if (response.id === undefined) return;
+                this.waiting.get(response.id)?.reject(new Error(response.message));
+                this.waiting.delete(response.id);
+            }
+        };
+        // An uncaught error may have stopped the worker, no request would be answered
+        worker.onerror = (event) => {
+            console.error(`Simulation worker: ${event.message}`);
+            this.rejectAll(new Error(event.message));
+        };
+    }
+
+    private rejectAll(error: Error): void {
+        for (const waiter of this.waiting.values()) waiter.reject(error);
+        this.waiting.clear();
+    }
+
+    // Resolves with the answer of the worker, the new state is on the front buffer
+    // by then. Rejects if the request failed in the worker. The lock of the reader is released first, it may hold the buffer
+    // the worker has to write and not read again until the answer.
+    private request(make: (id: number) => WorkerRequest): Promise<WorkerResponse> {
+        const id = this.nextId++;
+        this.source.release();
+        return new Promise((resolve, reject) => {
+            this.waiting.set(id, { resolve, reject });
+            this.worker.postMessage(make(id));
+        });
+    }
+
+    // Loads a baked in map (the demo grid for a negative index) and sets p
+    async load(map: number, p: number): Promise<void> {
+        await this.request(id => ({ type: 'load', id, map, p }));
+    }
+
+    async reset(): Promise<void> {
+        await this.request(id => ({ type: 'reset', id }));
+    }
+
+    // Loads a map and runs it to completion without pacing, resolves with the final metrics
+    async run(map: number, p: number): Promise<EngineMetrics> {
+        const response = await this.request(id => ({ type: 'run', id, map, p }));
+        if (response.type !== 'result') throw new Error(`Unexpected ${response.type} from the simulation worker`);
+        return response.metrics;
+    }
+
+    // Steps every `stepInterval` ms in the worker until stopped or complete
+    start(stepInterval: number): void {
+        this.worker.postMessage({ type: 'start', stepInterval } as WorkerRequest);
+    }
+
+    stop(): void {
+        this.worker.postMessage({ type: 'stop' } as WorkerRequest);
+    }
+
+    dispose(): void {
+        this.worker.terminate();
+        this.rejectAll(new Error('The simulation worker was disposed'));
+    }
+}
@@ -0,0 +1,360 @@
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "main.cpp" // Unity build, like the CLI and the tests
+#include "bench.h"
+#include "mapgen.h"
+
+// Microbenchmarks of the engine hot paths. Results go to stdout and, with
+// --json, to a JSON file for comparing runs (see `make bench`).
+//
+// With --scaling it runs whole simulations on generated column-tree maps of
+// increasing size instead. Large sizes need a build with a larger
+// GRID_MAX_SIZE (see `make bench-scaling`).
+
+void printHelp() {
+    std::cout << "Usage: bench [options]\n";
+    std::cout << "Options:\n";
+    std::cout << "  -h, --help           Show this help message\n";
+    std::cout << "  --json <file>        Write the results as JSON\n";
+    std::cout << "  --filter <text>      Only run benchmarks whose name contains the text\n";
+    std::cout << "  --samples <n>        Timed samples per benchmark\n";
+    std::cout << "  --min-time <ms>      Minimum duration of a sample\n";
+    std::cout << "Scaling mode:\n";
+    std::cout << "  --scaling            Simulate generated maps of increasing size\n";
+    std::cout << "  --cells <a,b,...>    Approximate cell counts of the maps (default 1e3,...,1e7)\n";
+    std::cout << "  --max-steps <n>      Step budget per map\n";
+    std::cout << "  --max-seconds <s>    Time budget per map\n";
+    std::cout << "  -p <value>           Active probability (0-100)\n";
+    std::cout << "  --seed <n>           Seed of the map generator and the simulation\n";
+}
+
+Bench::Context buildContext() {
+    return {
+        {"compiler", __VERSION__},
+        {"grid_layout", GridLayout::name},
+        {"grid_max_size", std::to_string(MAX_SIZE)},
+#if defined(NEIGHBORHOOD_KERNEL_AVX2)
+        {"neighborhood_kernel", "avx2"},
+#elif defined(NEIGHBORHOOD_KERNEL_SSE41)
+        {"neighborhood_kernel", "sse4.1"},
+#else
+        {"neighborhood_kernel", "scalar"},
+#endif
+    };
+}
+
+// Current resident memory. Unlike the peak (ru_maxrss) it drops and rises with
+// each size, so the change over one run is the memory that run touched first.
+// Pages an earlier size touched stay resident, the sizes run in increasing order.
+// Linux only, 0 elsewhere.
+double residentMemoryMb() {
+    std::ifstream statm("/proc/self/statm");
+    long long total = 0, resident = 0;
+    if (!(statm >> total >> resident)) return 0;
+    return resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+struct ScalingOptions {
+    std::vector<double> cells = {1e3, 1e4, 1e5, 1e6, 1e7};
+    // A map of n cells needs about n steps, the default budgets complete the
+    // smaller sizes and stop the larger ones on time
+    long long max_steps = 100000000;
+    double max_seconds = 60;
+    int p = 100;
+    unsigned seed = 1;
+};
+
+// Runs the engine on a generated map per size until it completes or runs out of
+// budget. The activations are the robot steps spent active, the sum of robot_time.
+std::vector<Bench::Record> runScaling(const ScalingOptions& options) {
+    std::vector<Bench::Record> records;
+    std::cout << "cells\tside\twalkable\tload_ms\tsteps\tcomplete\twall_ms\tsteps_per_s\tactivations_per_s\trss_delta_mb\n";
+
+    for (double target : options.cells) {
+        int side = (int)std::lround(std::cbrt(target));
+        if (side > MAX_SIZE) {
+            std::cerr << "Skipping " << target << " cells, side " << side << " is over GRID_MAX_SIZE=" << MAX_SIZE
+                      << " (use make bench-scaling)\n";
+            continue;
+        }
+
+        double rss_before = residentMemoryMb();
+        MapGen::GeneratedMap generated = MapGen::columnTree(side, side, side, 0.5, options.seed);
+        auto load_start = Bench::Clock::now();
+        load_map_info(generated.info());
+        double load_ms = Bench::elapsedNs(load_start) / 1e6;
+        set_active_probability(options.p);
+        std::srand(options.seed);
+
+        long long steps = 0;
+        auto start = Bench::Clock::now();
+        double wall_ns = 0;
+        while (!is_simulation_complete() && steps < options.max_steps && wall_ns < options.max_seconds * 1e9) {
+            simulate_step();
+            steps++;
+            wall_ns = Bench::elapsedNs(start);
+        }
+
+        double activations = 0;
+        for (int i = 0; i < robot_count; i++) {
+            activations += robot_time[i];
+        }
+        double wall_s = wall_ns / 1e9;
+        double steps_per_s = wall_s > 0 ? steps / wall_s : 0;
+        double activations_per_s = wall_s > 0 ? activations / wall_s : 0;
+        double cells = (double)side * side * side;
+        double rss_delta_mb = residentMemoryMb() - rss_before;
+
+        std::cout << (long long)cells << "\t" << side << "\t" << available_cells << "\t" << load_ms << "\t"
+                  << steps << "\t" << is_simulation_complete() << "\t" << wall_ns / 1e6 << "\t" << steps_per_s
+                  << "\t" << activations_per_s << "\t" << rss_delta_mb << "\n";
+
+        records.push_back({generated.name, {
+            {"cells", cells},
+            {"side", (double)side},
+            {"walkable", (double)available_cells},
+            {"load_ms", load_ms},
+            {"steps", (double)steps},
+            {"complete", is_simulation_complete() ? 1.0 : 0.0},
+            {"wall_ms", wall_ns / 1e6},
+            {"steps_per_s", steps_per_s},
+            {"activations", activations},
+            {"activations_per_s", activations_per_s},
+            {"rss_delta_mb", rss_delta_mb},
+        }});
+    }
+    return records;
+}
+
+// Random neighborhoods with the center taken by the robot. With `settle_ready`
+// every axis has a wall on one side, so lookCompute runs the connectivity check.
+std::vector<Neighborhood> randomNeighborhoods(int count, bool settle_ready, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> cell_state(0, 9);
+    std::uniform_int_distribution<int> side(0, 1);
+
+    std::vector<Neighborhood> neighborhoods;
+    for (int n = 0; n < count; n++) {
+        Neighborhood neighborhood = {0, 0, 0};
+        for (int i = 0; i < 27; i++) {
+            int value = cell_state(rng);
+            if (value < 4) neighborhood.wall |= 1u << i;          // 40% walls
+            else if (value < 5) neighborhood.occupied |= 1u << i; // 10% robots
+        }
+        neighborhood.wall &= ~NEIGHBORHOOD_CENTER_BIT;
+        neighborhood.occupied |= NEIGHBORHOOD_CENTER_BIT;
+
+        if (settle_ready) {
+            const Dir axes[3][2] = {{DIR_UP, DIR_DOWN}, {DIR_RIGHT, DIR_LEFT}, {DIR_FORWARD, DIR_BACK}};
+            for (const auto& axis : axes) {
+                unsigned bit = 1u << dir_neighbor_index(axis[side(rng)]);
+                neighborhood.wall |= bit;
+                neighborhood.occupied &= ~bit;
+            }
+        }
+        neighborhood.free = NEIGHBORHOOD_ALL & ~(neighborhood.wall | neighborhood.occupied);
+        neighborhoods.push_back(neighborhood);
+    }
+    return neighborhoods;
+}
+
+std::vector<Vector3Int> walkableCells() {
+    std::vector<Vector3Int> cells;
+    for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+            for (int z = 0; z < depth; z++) {
+                if (map(x, y, z)) cells.push_back(Vector3Int(x, y, z));
+            }
+        }
+    }
+    return cells;
+}
+
+int main(int argc, char* argv[]) {
+    Bench::Config config;
+    std::string jsonPath;
+    std::string filter;
+    bool scaling = false;
+    ScalingOptions scalingOptions;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printHelp();
+            return 0;
+        } else if (arg == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--samples" && i + 1 < argc) {
+            config.samples = std::stoi(argv[++i]);
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            config.min_sample_ms = std::stod(argv[++i]);
+        } else if (arg == "--scaling") {
+            scaling = true;
+        } else if (arg == "--cells" && i + 1 < argc) {
+            scalingOptions.cells.clear();
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                scalingOptions.cells.push_back(std::stod(item));
+            }
+        } else if (arg == "--max-steps" && i + 1 < argc) {
+            scalingOptions.max_steps = std::stoll(argv[++i]);
+        } else if (arg == "--max-seconds" && i + 1 < argc) {
+            scalingOptions.max_seconds = std::stod(argv[++i]);
+        } else if (arg == "-p" && i + 1 < argc) {
+            scalingOptions.p = std::stoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            scalingOptions.seed = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            printHelp();
+            return 1;
+        }
+    }
+
+    if (scaling) {
+        std::vector<Bench::Record> records = runScaling(scalingOptions);
+        if (!jsonPath.empty()) {
+            std::ofstream out(jsonPath);
+            if (!out) {
+                std::cerr << "Could not write " << jsonPath << "\n";
+                return 1;
+            }
+            Bench::Context context = buildContext();
+            context.push_back({"p", std::to_string(scalingOptions.p)});
+            context.push_back({"max_steps", std::to_string(scalingOptions.max_steps)});
+            Bench::writeJson(out, context, records);
+            std::cout << "Results written to " << jsonPath << "\n";
+        }
+        return 0;
+    }
+
+    std::vector<Bench::Result> results;
+    Bench::printHeader(std::cout);
+
+    auto enabled = [&](const std::string& name) {
+        return filter.empty() || name.find(filter) != std::string::npos;
+    };
+    auto record = [&](const Bench::Result& result) {
+        Bench::printResult(std::cout, result);
+        results.push_back(result);
+    };
+
+    // Reachability flood fill between two neighbors (Robot::reachable before the bit masks)
+    const std::vector<Neighborhood> neighborhoods = randomNeighborhoods(1024, false, 1);
+    if (enabled("reachable")) {
+        record(Bench::run("reachable", config, [&]() {
+            long long reached = 0;
+            for (const Neighborhood& neighborhood : neighborhoods) {
+                unsigned open = NEIGHBORHOOD_ALL & ~neighborhood.wall;
+                reached += neighborhood_flood(1u << 4, open);
+            }
+            Bench::sink(reached);
+            return (long long)neighborhoods.size();
+        }));
+    }
+
+    // Full decision of a robot that passed the wall condition of settling
+    const std::vector<Neighborhood> settleNeighborhoods = randomNeighborhoods(1024, true, 2);
+    if (enabled("look_compute_settle")) {
+        Robot base(Vector3Int(1, 1, 1));
+        base.ever_moved = true;
+        record(Bench::run("look_compute_settle", config, [&]() {
+            long long settled = 0;
+            for (const Neighborhood& neighborhood : settleNeighborhoods) {
+                Robot robot = base;
+                robot.lookCompute(neighborhood, 0);
+                settled += robot.active ? 0 : 1;
+            }
+            Bench::sink(settled);
+            return (long long)settleNeighborhoods.size();
+        }));
+    }
+
+    // Neighborhood gathers over every walkable cell of the largest baked in map
+    load_map(WasmMaps::ALL_MAPS_COUNT - 1);
+    const std::vector<Vector3Int> cells = walkableCells();
+    if (enabled("generate_neighbors")) {
+        record(Bench::run("generate_neighbors", config, [&]() {
+            array<CellState, 3*3*3> neighbors;
+            long long checksum = 0;
+            for (const Vector3Int& cell : cells) {
+                generateNeighbors(cell.x, cell.y, cell.z, neighbors);
+                checksum += neighbors[13];
+            }
+            Bench::sink(checksum);
+            return (long long)cells.size();
+        }));
+    }
+    if (enabled("gather_neighborhood")) {
+        refresh_cell_states();
+        record(Bench::run("gather_neighborhood", config, [&]() {
+            long long checksum = 0;
+            for (const Vector3Int& cell : cells) {
+                checksum += gatherNeighborhood(cell.x, cell.y, cell.z).wall;
+            }
+            Bench::sink(checksum);
+            return (long long)cells.size();
+        }));
+    }
+
+    for (int mapIndex = 0; mapIndex < WasmMaps::ALL_MAPS_COUNT; ++mapIndex) {
+        std::string mapName = WasmMaps::all_maps[mapIndex].name;
+
+        if (enabled("bfs/" + mapName)) {
+            load_map(mapIndex);
+            record(Bench::run("bfs/" + mapName, config, []() {
+                bfs();
+                return 1LL;
+            }));
+        }
+
+        if (enabled("load_map/" + mapName)) {
+            record(Bench::run("load_map/" + mapName, config, [=]() {
+                load_map(mapIndex);
+                return 1LL;
+            }));
+        }
+
+        // Whole runs from a fresh map with a fixed seed, the time is per step
+        for (int p : {40, 70, 100}) {
+            std::string name = "simulate_step/" + mapName + "/p" + std::to_string(p);
+            if (!enabled(name)) continue;
+            record(Bench::run(name, config, [=]() {
+                std::srand(1);
+                load_map(mapIndex);
+                set_active_probability(p);
+            }, []() {
+                long long steps = 0;
+                while (!is_simulation_complete()) {
+                    simulate_step();
+                    steps++;
+                }
+                return steps;
+            }));
+        }
+    }
+
+    if (!jsonPath.empty()) {
+        std::ofstream out(jsonPath);
+        if (!out) {
+            std::cerr << "Could not write " << jsonPath << "\n";
+            return 1;
+        }
+        Bench::Context context = buildContext();
+        context.push_back({"samples", std::to_string(config.samples)});
+        Bench::writeJson(out, context, results);
+        std::cout << "Results written to " << jsonPath << "\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Small benchmark harness for the native benchmark binaries: repeated timed
+// samples with mean/stddev/min/max in ns per operation, a table on stdout and a
+// JSON report that can be compared across changes.
+
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace Bench {
+
+using Clock = std::chrono::steady_clock;
+
+struct Config {
+    int samples = 10;          // Timed samples per benchmark
+    double min_sample_ms = 20; // Every sample repeats the body until it ran this long
+    double warmup_ms = 20;     // Untimed runs before the first sample
+};
+
+struct Result {
+    std::string name;
+    int samples = 0;
+    long long ops = 0;  // Operations over all samples
+    double mean_ns = 0; // Per operation
+    double stddev_ns = 0;
+    double min_ns = 0;
+    double max_ns = 0;
+};
+
+// Keeps a value alive so the compiler can not drop the benchmarked work
+inline void sink(long long value) {
+    static volatile long long sink_value = 0;
+    sink_value = sink_value + value;
+}
+
+inline double elapsedNs(Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// `setup` runs untimed before every call of `body`, `body` returns the number
+// of operations it performed
+inline Result run(const std::string& name, const Config& config,
+                  const std::function<void()>& setup, const std::function<long long()>& body) {
+    Result result;
+    result.name = name;
+
+    double warmup_ns = 0;
+    while (warmup_ns < config.warmup_ms * 1e6) {
+        setup();
+        auto start = Clock::now();
+        sink(body());
+        warmup_ns += elapsedNs(start);
+    }
+
+    std::vector<double> per_op;
+    for (int sample = 0; sample < config.samples; sample++) {
+        double sample_ns = 0;
+        long long sample_ops = 0;
+        while (sample_ns < config.min_sample_ms * 1e6 || sample_ops == 0) {
+            setup();
+            auto start = Clock::now();
+            sample_ops += body();
+            sample_ns += elapsedNs(start);
+        }
+        per_op.push_back(sample_ns / sample_ops);
+        result.ops += sample_ops;
+    }
+
+    double sum = 0;
+    result.min_ns = per_op[0];
+    result.max_ns = per_op[0];
+    for (double value : per_op) {
+        sum += value;
+        if (value < result.min_ns) result.min_ns = value;
+        if (value > result.max_ns) result.max_ns = value;
+    }
+    result.samples = (int)per_op.size();
+    result.mean_ns = sum / per_op.size();
+
+    double squares = 0;
+    for (double value : per_op) {
+        squares += (value - result.mean_ns) * (value - result.mean_ns);
+    }
+    result.stddev_ns = per_op.size() > 1 ? std::sqrt(squares / (per_op.size() - 1)) : 0.0;
+    return result;
+}
+
+inline Result run(const std::string& name, const Config& config, const std::function<long long()>& body) {
+    return run(name, config, []() {}, body);
+}
+
+// Named values of one measurement, for reports that are not ns/op timings
+struct Record {
+    std::string name;
+    std::vector<std::pair<std::string, double>> values;
+};
+
+inline void printHeader(std::ostream& out) {
+    out << std::left << std::setw(40) << "benchmark" << std::right
+        << std::setw(14) << "ns/op" << std::setw(12) << "stddev" << std::setw(8) << "cv%"
+        << std::setw(14) << "min" << std::setw(14) << "max" << "\n";
+}
+
+inline void printResult(std::ostream& out, const Result& result) {
+    double cv = result.mean_ns > 0 ? 100.0 * result.stddev_ns / result.mean_ns : 0.0;
+    out << std::left << std::setw(40) << result.name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(14) << result.mean_ns << std::setw(12) << result.stddev_ns << std::setw(8) << cv
+        << std::setw(14) << result.min_ns << std::setw(14) << result.max_ns << "\n";
+    out.unsetf(std::ios::fixed);
+    out << std::setprecision(6);
+}
+
+inline std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+using Context = std::vector<std::pair<std::string, std::string>>;
+
+inline void writeJsonContext(std::ostream& out, const Context& context) {
+    out << "{\n  \"context\": {";
+    for (size_t i = 0; i < context.size(); i++) {
+        out << (i ? ",\n" : "\n") << "    \"" << jsonEscape(context[i].first) << "\": \""
+            << jsonEscape(context[i].second) << "\"";
+    }
+    out << "\n  },\n";
+}
+
+// `context` holds extra key/value pairs describing the build and the machine
+inline void writeJson(std::ostream& out, const Context& context, const std::vector<Result>& results) {
+    writeJsonContext(out, context);
+    out << "  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        out << (i ? ",\n" : "\n") << std::setprecision(10)
+            << "    {\"name\": \"" << jsonEscape(r.name) << "\", \"samples\": " << r.samples
+            << ", \"ops\": " << r.ops << ", \"mean_ns\": " << r.mean_ns << ", \"stddev_ns\": " << r.stddev_ns
+            << ", \"min_ns\": " << r.min_ns << ", \"max_ns\": " << r.max_ns << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+inline void writeJson(std::ostream& out, const Context& context, const std::vector<Record>& records) {
+    writeJsonContext(out, context);
+    out << "  \"records\": [";
+    for (size_t i = 0; i < records.size(); i++) {
+        out << (i ? ",\n" : "\n") << std::setprecision(10) << "    {\"name\": \"" << jsonEscape(records[i].name) << "\"";
+        for (const auto& value : records[i].values) {
+            out << ", \"" << jsonEscape(value.first) << "\": " << value.second;
+        }
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+} // namespace Bench
+
+#endif // BENCH_H
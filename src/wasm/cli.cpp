@@ -2,16 +2,52 @@
 #include <vector>
 #include <string>
 #include <algorithm>
-#include <numeric>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <set>
 #include "main.cpp" // Include the WASM source code
+#include "perf_counters.h"
+#include "stats.h"
+#include "sweep.h"
 
 void printHelp() {
     std::cout << "Usage: wasm_cli [options]\n";
+    std::cout << "       wasm_cli sweep [sweep options]\n";
     std::cout << "Options:\n";
     std::cout << "  -h, --help           Show this help message\n";
     std::cout << "  -p <value>           Set active probability (0-100)\n";
     std::cout << "  -m <index>           Set map index to load\n";
     std::cout << "  -n <simulations>     Set number of simulations to run\n";
+    std::cout << "  -e <direction>       Set external direction (up, forward, left, down, back, right)\n";
+    std::cout << "  --target-ci <width>  Run until the 95% CI of the mean is narrower than width * mean,\n";
+    std::cout << "                       -n is then the minimum number of simulations\n";
+    std::cout << "  --max-n <count>      Stop --target-ci runs after this many simulations (default 10000)\n";
+    std::cout << "  --ci-metric <name>   Metric of --target-ci (makespan, e_total, e_max, t_total, t_max)\n";
+    std::cout << "  --record <file>      Record the trajectory of the first simulation for replays\n";
+    std::cout << "  --profile            Print the step profile (build with make PROFILE=1)\n";
+    std::cout << "  --perf               Add hardware counters per phase to the profile (Linux)\n";
+    std::cout << "Sweep options:\n";
+    std::cout << "  -m <list>            Map indices, e.g. 0,1 or 0:1\n";
+    std::cout << "  -p <list>            Active probabilities, e.g. 50,70 or 10:100:10\n";
+    std::cout << "  -n <replicates>      Replicates per map and probability\n";
+    std::cout << "  -e <direction>       External direction\n";
+    std::cout << "  -j <workers>         Worker processes (default: number of CPUs)\n";
+    std::cout << "  -o <file>            Result file, finished jobs in it are not run again (default sweep.tsv)\n";
+    std::cout << "  --seed <value>       Base of the per job random seeds (default 0)\n";
+    std::cout << "  --shard <i>/<n>      Only run shard i of n, the jobs are split the same way on every machine\n";
+    std::cout << "  --aggregate <file>   Write the binary partial aggregate (default <result file>.agg with --shard)\n";
+    std::cout << "       wasm_cli merge <aggregate files>\n";
+    std::cout << "                       Combine the partial aggregates of the shards of a sweep\n";
+}
+
+// Direction code of a name, DIR_NONE if the name is unknown
+Dir parseDirection(const std::string& name) {
+    const char* names[DIR_COUNT] = {"up", "forward", "left", "down", "back", "right"};
+    for (int d = 0; d < DIR_COUNT; d++) {
+        if (name == names[d]) return (Dir)d;
+    }
+    return DIR_NONE;
 }
 
 
@@ -24,44 +60,466 @@ struct SimulationMetrics {
     int available_cells;
 };
 
-void logMetrics(const std::vector<SimulationMetrics>& metrics) {
-    auto calculateStats = [](const std::vector<int>& values) {
-        int min = *std::min_element(values.begin(), values.end());
-        int max = *std::max_element(values.begin(), values.end());
-        double avg = std::accumulate(values.begin(), values.end(), 0.0) / values.size();
-        return std::make_tuple(min, max, avg);
-    };
+// Streaming aggregate of the replicates, constant memory for any number of simulations
+struct MetricsAggregate {
+    Stats::Metric makespan;
+    Stats::Metric e_total;
+    Stats::Metric e_max;
+    Stats::Metric t_total;
+    Stats::Metric t_max;
+    Stats::Metric available_cells;
 
-    std::vector<int> makespans, e_totals, e_maxs, t_totals, t_maxs, available_cells;
-    for (const auto& metric : metrics) {
-        makespans.push_back(metric.makespan);
-        e_totals.push_back(metric.e_total);
-        e_maxs.push_back(metric.e_max);
-        t_totals.push_back(metric.t_total);
-        t_maxs.push_back(metric.t_max);
-        available_cells.push_back(metric.available_cells);
+    // Adds `n` replicates with the same metrics
+    void add(const SimulationMetrics& metric, uint64_t n = 1) {
+        makespan.add(metric.makespan, n);
+        e_total.add(metric.e_total, n);
+        e_max.add(metric.e_max, n);
+        t_total.add(metric.t_total, n);
+        t_max.add(metric.t_max, n);
+        available_cells.add(metric.available_cells, n);
     }
 
-    auto [minMakespan, maxMakespan, avgMakespan] = calculateStats(makespans);
-    auto [minETotal, maxETotal, avgETotal] = calculateStats(e_totals);
-    auto [minEMax, maxEMax, avgEMax] = calculateStats(e_maxs);
-    auto [minTTotal, maxTTotal, avgTTotal] = calculateStats(t_totals);
-    auto [minTMax, maxTMax, avgTMax] = calculateStats(t_maxs);
-    auto [minCells, maxCells, avgCells] = calculateStats(available_cells);
+    void merge(const MetricsAggregate& other) {
+        makespan.merge(other.makespan);
+        e_total.merge(other.e_total);
+        e_max.merge(other.e_max);
+        t_total.merge(other.t_total);
+        t_max.merge(other.t_max);
+        available_cells.merge(other.available_cells);
+    }
+
+    void write(std::ostream& out) const {
+        for (const Stats::Metric* metric : {&makespan, &e_total, &e_max, &t_total, &t_max, &available_cells}) {
+            metric->write(out);
+        }
+    }
+
+    bool read(std::istream& in) {
+        for (Stats::Metric* metric : {&makespan, &e_total, &e_max, &t_total, &t_max, &available_cells}) {
+            if (!metric->read(in)) return false;
+        }
+        return true;
+    }
+
+    // Metric by its command line name, nullptr if the name is unknown
+    const Stats::Metric* find(const std::string& name) const {
+        if (name == "makespan") return &makespan;
+        if (name == "e_total") return &e_total;
+        if (name == "e_max") return &e_max;
+        if (name == "t_total") return &t_total;
+        if (name == "t_max") return &t_max;
+        return nullptr;
+    }
+};
+
+void logMetrics(const MetricsAggregate& metrics) {
+    // The metrics are integers, the sketch estimates are within 0.5% of them
+    auto logMetric = [](const char* label, const Stats::Metric& metric) {
+        const Stats::Summary& s = metric.summary;
+        std::cout << label << "Min=" << (long long)s.min << " Max=" << (long long)s.max << " Avg=" << s.mean()
+                  << " StdDev=" << s.stddev()
+                  << " P50=" << std::llround(metric.quantile(0.5))
+                  << " P90=" << std::llround(metric.quantile(0.9))
+                  << " P99=" << std::llround(metric.quantile(0.99)) << "\n";
+    };
 
     std::cout << "Simulation Metrics:\n";
-    std::cout << "  Available Cells: Min=" << minCells << " Max=" << maxCells << " Avg=" << avgCells << "\n";
-    std::cout << "  Makespan:        Min=" << minMakespan << " Max=" << maxMakespan << " Avg=" << avgMakespan << "\n";
-    std::cout << "  E_Total:         Min=" << minETotal << " Max=" << maxETotal << " Avg=" << avgETotal << "\n";
-    std::cout << "  E_Max:           Min=" << minEMax << " Max=" << maxEMax << " Avg=" << avgEMax << "\n";
-    std::cout << "  T_Total:         Min=" << minTTotal << " Max=" << maxTTotal << " Avg=" << avgTTotal << "\n";
-    std::cout << "  T_Max:           Min=" << minTMax << " Max=" << maxTMax << " Avg=" << avgTMax << "\n";
+    logMetric("  Available Cells: ", metrics.available_cells);
+    logMetric("  Makespan:        ", metrics.makespan);
+    logMetric("  E_Total:         ", metrics.e_total);
+    logMetric("  E_Max:           ", metrics.e_max);
+    logMetric("  T_Total:         ", metrics.t_total);
+    logMetric("  T_Max:           ", metrics.t_max);
+}
+
+// Ends the recording of the current run and writes it to a file
+bool writeTrajectory(const std::string& path) {
+    int size = trajectory_finish();
+    if (size <= 0) return false;
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write((const char*)get_trajectory_buffer(), size);
+    return (bool)out;
+}
+
+void logProfile() {
+    if (!is_profiler_enabled()) {
+        std::cout << "Profile: not available, rebuild with make PROFILE=1\n";
+        return;
+    }
+
+    const char* phaseNames[PHASE_COUNT] = {"CellStates", "Neighbors", "LookCompute", "Robots", "Move", "RobotField"};
+    const char* counterNames[COUNTER_COUNT] = {"Activations", "SettleChecks", "Reachable", "Moves", "Collisions"};
+    int steps = get_profile_steps();
+    double totalNs = 0;
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        totalNs += get_profile_total_phase_ns(i);
+    }
+
+    std::cout << "Step Profile (" << steps << " steps):\n";
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        double phaseNs = get_profile_total_phase_ns(i);
+        std::cout << "  " << phaseNames[i] << ": Total=" << phaseNs / 1e6 << "ms"
+                  << " PerStep=" << (steps > 0 ? phaseNs / 1e3 / steps : 0.0) << "us"
+                  << " Share=" << (totalNs > 0 ? 100.0 * phaseNs / totalNs : 0.0) << "%\n";
+    }
+    for (int i = 0; i < COUNTER_COUNT; ++i) {
+        double count = get_profile_total_counter(i);
+        std::cout << "  " << counterNames[i] << ": Total=" << (long long)count
+                  << " PerStep=" << (steps > 0 ? count / steps : 0.0) << "\n";
+    }
+}
+
+void logPerfCounters(const PerfCounters::PhaseCounts& counts) {
+    const char* phaseNames[PHASE_COUNT] = {"CellStates", "Neighbors", "LookCompute", "Robots", "Move", "RobotField"};
+    auto ratio = [](uint64_t a, uint64_t b) { return b > 0 ? (double)a / b : 0.0; };
+
+    std::cout << "Hardware Counters:\n";
+    for (int i = 0; i < PHASE_COUNT; ++i) {
+        // The samples do not read the counters, their work counts to Robots
+        if (i == PHASE_NEIGHBORS || i == PHASE_LOOK_COMPUTE) continue;
+        const uint64_t* c = counts.totals[i];
+        std::cout << "  " << phaseNames[i] << ":"
+                  << " Cycles=" << c[PerfCounters::CYCLES]
+                  << " Instructions=" << c[PerfCounters::INSTRUCTIONS]
+                  << " IPC=" << ratio(c[PerfCounters::INSTRUCTIONS], c[PerfCounters::CYCLES])
+                  << " CacheMisses=" << c[PerfCounters::CACHE_MISSES]
+                  << " (" << 100.0 * ratio(c[PerfCounters::CACHE_MISSES], c[PerfCounters::CACHE_REFERENCES]) << "%)"
+                  << " BranchMisses=" << c[PerfCounters::BRANCH_MISSES]
+                  << " (" << 100.0 * ratio(c[PerfCounters::BRANCH_MISSES], c[PerfCounters::BRANCHES]) << "%)\n";
+    }
+    for (int i = 0; i < PerfCounters::EVENT_COUNT; ++i) {
+        if (counts.group.slots[i] < 0) {
+            std::cout << "  (" << PerfCounters::eventName(i) << " is not supported here, reported as 0)\n";
+        }
+    }
+}
+
+// Engine state right after a map was loaded, restoring it skips the decoding and the BFS of load_map
+struct LoadedMap {
+    int size_x, size_y, size_z;
+    Vector3Int start;
+    int available_cells;
+    std::vector<bool> walkable;
+    std::vector<int> distance;
+};
+
+// Decoded maps of a sweep worker, every job of a map after the first one starts from the copy
+class MapCache {
+public:
+    // Leaves the engine in the state of reset_simulation after loading the map
+    void load(int mapIndex) {
+        auto found = maps.find(mapIndex);
+        if (found == maps.end()) {
+            load_map(mapIndex);
+            reset_simulation();
+            maps[mapIndex] = save();
+            return;
+        }
+        const LoadedMap& loaded = found->second;
+        init_grid(loaded.size_x, loaded.size_y, loaded.size_z);
+        int extent = grid_layout.extent();
+        for (int i = 0; i < extent; i++) {
+            map.cells[i] = loaded.walkable[i];
+            distances.cells[i] = loaded.distance[i];
+        }
+        start_pos = loaded.start;
+        available_cells = loaded.available_cells;
+        last_loaded_map_index = mapIndex;
+    }
+
+private:
+    LoadedMap save() const {
+        int extent = grid_layout.extent();
+        LoadedMap loaded{height, width, depth, start_pos, available_cells,
+                         std::vector<bool>(map.cells, map.cells + extent),
+                         std::vector<int>(distances.cells, distances.cells + extent)};
+        return loaded;
+    }
+
+    std::map<int, LoadedMap> maps;
+};
+
+// Runs one sweep job with its own seed, p = 100 runs are deterministic and only simulated once per map
+struct SweepRunner {
+    int dir;
+    uint64_t seedBase;
+    MapCache maps;
+    std::map<int, Sweep::Result> synchronous;
+
+    void run(const Sweep::Job& job, Sweep::Result& result) {
+        result.job = job;
+        result.dir = dir;
+        result.seed = Sweep::jobSeed(seedBase, dir, job);
+        if (job.p >= 100) {
+            auto found = synchronous.find(job.map);
+            if (found != synchronous.end()) {
+                for (int i = 0; i < Sweep::VALUE_COUNT; i++) result.values[i] = found->second.values[i];
+                return;
+            }
+        }
+
+        maps.load(job.map);
+        set_active_probability(job.p);
+        std::srand(result.seed);
+        simulate_steps(SIMULATE_UNTIL_COMPLETE);
+
+        const int values[Sweep::VALUE_COUNT] = {get_makespan(), get_e_total(), get_e_max(), get_t_total(), get_t_max(), get_available_cells()};
+        for (int i = 0; i < Sweep::VALUE_COUNT; i++) result.values[i] = values[i];
+        if (job.p >= 100) synchronous[job.map] = result;
+    }
+};
+
+SimulationMetrics toSimulationMetrics(const Sweep::Result& result) {
+    const int* v = result.values;
+    return {v[0], v[1], v[2], v[3], v[4], v[5]};
+}
+
+// Aggregates of the (map, p) points of a sweep
+using SweepPoints = std::map<std::pair<int, int>, MetricsAggregate>;
+
+void logSweepResults(const SweepPoints& points) {
+    std::cout << "Sweep Results:\n";
+    for (const auto& entry : points) {
+        const MetricsAggregate& point = entry.second;
+        const Stats::Metric& m = point.makespan;
+        std::cout << "  Map=" << entry.first.first << " P=" << entry.first.second << " N=" << m.summary.count
+                  << " Makespan: Avg=" << m.summary.mean() << " StdDev=" << m.summary.stddev()
+                  << " P50=" << std::llround(m.quantile(0.5)) << " P90=" << std::llround(m.quantile(0.9))
+                  << " P99=" << std::llround(m.quantile(0.99))
+                  << " E_Total: Avg=" << point.e_total.summary.mean()
+                  << " T_Total: Avg=" << point.t_total.summary.mean() << "\n";
+    }
+}
+
+bool writeAggregateFile(const std::string& path, Sweep::AggregateHeader header, const SweepPoints& points) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    header.points = points.size();
+    header.write(out);
+    for (const auto& entry : points) {
+        Stats::writeVarint(out, entry.first.first);
+        Stats::writeVarint(out, entry.first.second);
+        entry.second.write(out);
+    }
+    return (bool)out;
+}
+
+bool readAggregateFile(const std::string& path, Sweep::AggregateHeader& header, SweepPoints& points) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in || !header.read(in)) return false;
+    for (uint64_t i = 0; i < header.points; i++) {
+        uint64_t mapIndex, p;
+        MetricsAggregate point;
+        if (!Stats::readVarint(in, mapIndex) || !Stats::readVarint(in, p) || !point.read(in)) return false;
+        points[{(int)mapIndex, (int)p}].merge(point);
+    }
+    return true;
+}
+
+// Combines the partial aggregates of the shards, the result equals the one of a single sweep
+int runMerge(int argc, char* argv[]) {
+    if (argc < 3) {
+        printHelp();
+        return 1;
+    }
+
+    SweepPoints points;
+    Sweep::AggregateHeader first;
+    std::set<int> shards;
+    for (int i = 2; i < argc; ++i) {
+        Sweep::AggregateHeader header;
+        if (!readAggregateFile(argv[i], header, points)) {
+            std::cerr << "Invalid aggregate file: " << argv[i] << "\n";
+            return 1;
+        }
+        if (i == 2) {
+            first = header;
+        } else if (!header.sameSweep(first)) {
+            std::cerr << "Aggregate file of a different sweep: " << argv[i] << "\n";
+            return 1;
+        }
+        if (!shards.insert(header.shard.index).second) {
+            std::cerr << "Shard " << header.shard.index << " is given twice: " << argv[i] << "\n";
+            return 1;
+        }
+    }
+
+    std::cout << "Merged Shards:            " << shards.size() << " of " << first.shard.count << "\n";
+    for (int shard = 0; shard < first.shard.count; shard++) {
+        if (!shards.count(shard)) std::cout << "  Missing shard:          " << shard << "\n";
+    }
+    std::cout << std::endl;
+
+    logSweepResults(points);
+    return shards.size() == (size_t)first.shard.count ? 0 : 2;
+}
+
+// Runs the (map, p, replicate) jobs that are not in the result file yet, then reports every point
+int runSweep(int argc, char* argv[]) {
+    std::vector<int> mapIndices, pValues;
+    int replicates = 1;
+    std::string externalDirection = "up";
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cpus > 0 ? (int)cpus : 1;
+    std::string outputPath = "sweep.tsv";
+    uint64_t seedBase = 0;
+    Sweep::Shard shard;
+    std::string aggregatePath;
+
+    for (int i = 2; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printHelp();
+            return 0;
+        } else if ((arg == "-m" || arg == "-p") && i + 1 < argc) {
+            std::vector<int>& values = arg == "-m" ? mapIndices : pValues;
+            if (!Sweep::parseList(argv[++i], values)) {
+                std::cerr << "Invalid list for " << arg << ": " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (arg == "-n" && i + 1 < argc) {
+            replicates = std::stoi(argv[++i]);
+        } else if (arg == "-e" && i + 1 < argc) {
+            externalDirection = argv[++i];
+            if (parseDirection(externalDirection) == DIR_NONE) {
+                std::cerr << "Unknown direction: " << externalDirection << "\n";
+                return 1;
+            }
+        } else if (arg == "-j" && i + 1 < argc) {
+            workers = std::stoi(argv[++i]);
+        } else if (arg == "-o" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seedBase = std::stoull(argv[++i]);
+        } else if (arg == "--shard" && i + 1 < argc) {
+            if (!Sweep::parseShard(argv[++i], shard)) {
+                std::cerr << "Invalid shard, expected <i>/<n> with i < n: " << argv[i] << "\n";
+                return 1;
+            }
+        } else if (arg == "--aggregate" && i + 1 < argc) {
+            aggregatePath = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            printHelp();
+            return 1;
+        }
+    }
+    if (mapIndices.empty()) mapIndices.push_back(0);
+    if (pValues.empty()) pValues.push_back(50);
+    for (int mapIndex : mapIndices) {
+        if (mapIndex < 0 || mapIndex >= get_map_count()) {
+            std::cerr << "Invalid map index: " << mapIndex << "\n";
+            return 1;
+        }
+    }
+    for (int p : pValues) {
+        if (p < 0 || p > 100) {
+            std::cerr << "Invalid probability: " << p << "\n";
+            return 1;
+        }
+    }
+
+    if (aggregatePath.empty() && shard.count > 1) aggregatePath = outputPath + ".agg";
+
+    Sweep::ResultFile file;
+    if (!file.open(outputPath)) {
+        std::cerr << "Can not open the result file: " << outputPath << "\n";
+        return 1;
+    }
+
+    Dir dir = parseDirection(externalDirection);
+    set_external_direction(dir);
+    std::set<std::tuple<int, int, int, int, uint32_t>> done;
+    for (const Sweep::Result& result : file.all()) {
+        done.insert(Sweep::resultKey(result.job, result.dir, result.seed));
+    }
+
+    // Jobs of the same map are next to each other, so a worker mostly reuses its decoded map
+    std::vector<Sweep::Job> jobs;
+    std::set<std::pair<int, int>> wanted;
+    int total = 0;
+    for (int mapIndex : mapIndices) {
+        for (int p : pValues) {
+            wanted.insert({mapIndex, p});
+            for (int r = 0; r < replicates; r++) {
+                Sweep::Job job{mapIndex, p, r};
+                if (!Sweep::inShard(job, shard)) continue;
+                total++;
+                if (!done.count(Sweep::resultKey(job, dir, Sweep::jobSeed(seedBase, dir, job)))) {
+                    jobs.push_back(job);
+                }
+            }
+        }
+    }
+
+    std::cout << "Sweep Parameters:\n";
+    std::cout << "  Maps:                   " << mapIndices.size() << "\n";
+    std::cout << "  Probabilities:          " << pValues.size() << "\n";
+    std::cout << "  Replicates:             " << replicates << "\n";
+    std::cout << "  External Direction:     " << externalDirection << "\n";
+    std::cout << "  Seed:                   " << seedBase << "\n";
+    std::cout << "  Result File:            " << outputPath << "\n";
+    if (shard.count > 1) {
+        std::cout << "  Shard:                  " << shard.index << "/" << shard.count << "\n";
+    }
+    std::cout << "  Jobs:                   " << total << " (" << total - (int)jobs.size() << " already done)\n";
+    std::cout << "  Workers:                " << workers << "\n";
+    std::cout << std::endl;
+
+    SweepRunner runner{dir, seedBase};
+    bool ok = Sweep::runPool(jobs, workers,
+        [&](const Sweep::Job& job, Sweep::Result& result) { runner.run(job, result); },
+        [&](const Sweep::Result& result) { file.append(result); });
+    if (!ok) {
+        std::cerr << "A worker exited early, run the sweep again to finish the remaining jobs\n";
+        return 1;
+    }
+
+    // Every point aggregates the results of this sweep's jobs, whichever run produced them
+    SweepPoints points;
+    std::set<std::tuple<int, int, int, int, uint32_t>> counted;
+    for (const Sweep::Result& result : file.all()) {
+        const Sweep::Job& job = result.job;
+        if (result.dir != dir || job.replicate >= replicates || result.seed != Sweep::jobSeed(seedBase, dir, job)) continue;
+        if (!wanted.count({job.map, job.p}) || !Sweep::inShard(job, shard)) continue;
+        if (!counted.insert(Sweep::resultKey(job, result.dir, result.seed)).second) continue;
+        points[{job.map, job.p}].add(toSimulationMetrics(result));
+    }
+
+    logSweepResults(points);
+
+    if (!aggregatePath.empty()) {
+        Sweep::AggregateHeader header;
+        header.shard = shard;
+        header.seed = seedBase;
+        header.dir = dir;
+        header.replicates = replicates;
+        if (!writeAggregateFile(aggregatePath, header, points)) {
+            std::cerr << "Can not write the aggregate file: " << aggregatePath << "\n";
+            return 1;
+        }
+        std::cout << "\nPartial aggregate written to " << aggregatePath << "\n";
+    }
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "sweep") {
+        return runSweep(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "merge") {
+        return runMerge(argc, argv);
+    }
+
     int pValue = 50;
     int mapIndex = 0;
     int numSimulations = 1;
+    std::string externalDirection = "up";
+    bool profile = false;
+    bool perf = false;
+    double targetCi = 0; // Relative CI width, 0 runs exactly numSimulations
+    int maxSimulations = 10000;
+    std::string ciMetric = "makespan";
+    std::string recordPath;
 
     for (int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
@@ -74,6 +532,29 @@ int main(int argc, char* argv[]) {
             mapIndex = std::stoi(argv[++i]);
         } else if (arg == "-n" && i + 1 < argc) {
             numSimulations = std::stoi(argv[++i]);
+        } else if (arg == "--target-ci" && i + 1 < argc) {
+            targetCi = std::stod(argv[++i]);
+        } else if (arg == "--max-n" && i + 1 < argc) {
+            maxSimulations = std::stoi(argv[++i]);
+        } else if (arg == "--ci-metric" && i + 1 < argc) {
+            ciMetric = argv[++i];
+            if (!MetricsAggregate().find(ciMetric)) {
+                std::cerr << "Unknown metric: " << ciMetric << "\n";
+                return 1;
+            }
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (arg == "--profile") {
+            profile = true;
+        } else if (arg == "--perf") {
+            profile = true;
+            perf = true;
+        } else if (arg == "-e" && i + 1 < argc) {
+            externalDirection = argv[++i];
+            if (parseDirection(externalDirection) == DIR_NONE) {
+                std::cerr << "Unknown direction: " << externalDirection << "\n";
+                return 1;
+            }
         } else {
             std::cerr << "Unknown option: " << arg << "\n";
             printHelp();
@@ -81,36 +562,97 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    std::vector<SimulationMetrics> metrics;
+    MetricsAggregate metrics;
 
     // Print input parameters for reproducibility
     std::cout << "Simulation Parameters:\n";
     std::cout << "  Active Probability (p): " << pValue << "\n";
     std::cout << "  Map Index:              " << mapIndex << "\n";
     std::cout << "  Number of Simulations:   " << numSimulations << "\n";
+    std::cout << "  External Direction:     " << externalDirection << "\n";
+    if (targetCi > 0) {
+        std::cout << "  Target CI:              " << targetCi << " (" << ciMetric << ", max " << maxSimulations << ")\n";
+    }
     std::cout << std::endl;
 
-    for (int i = 0; i < numSimulations; ++i) {
-        load_map(mapIndex);
-        set_active_probability(pValue);
+    set_external_direction(parseDirection(externalDirection));
+
+    // The counters are read at the phase boundaries of the profiler, so they need a PROFILE=1 build
+    PerfCounters::PhaseCounts perfCounts;
+    if (perf && is_profiler_enabled()) {
+        if (perfCounts.group.open()) {
+            PerfCounters::active_phase_counts = &perfCounts;
+            g_profiler.phase_hook = PerfCounters::phaseHook;
+        } else {
+            std::cout << "Hardware counters: not available (" << perfCounts.group.error << ")";
+            if (perfCounts.group.permission_denied) {
+                std::cout << ", check /proc/sys/kernel/perf_event_paranoid";
+            }
+            std::cout << "\n\n";
+        }
+    }
+
+    // With a target CI, -n is the minimum and the loop stops as soon as the CI is narrow enough
+    const Stats::Metric* stopMetric = metrics.find(ciMetric);
+    int runs = 0;
+    auto needsMoreRuns = [&]() {
+        if (targetCi <= 0) return runs < numSimulations;
+        if (runs < std::max(numSimulations, 2)) return true;
+        return runs < maxSimulations && stopMetric->summary.relativeCiWidth() > targetCi;
+    };
+    while (needsMoreRuns()) {
+        bool record = runs == 0 && !recordPath.empty();
+        int copies = 1;
+        if (pValue >= 100 && !record) {
+            // Deterministic, so one run (or memo hit) stands for every replicate still needed
+            if (run_synchronous(mapIndex) < 0) {
+                std::cerr << "Invalid map index: " << mapIndex << "\n";
+                return 1;
+            }
+            copies = std::max(1, (targetCi > 0 ? std::max(numSimulations, 2) : numSimulations) - runs);
+        } else {
+            load_map(mapIndex);
+            set_active_probability(pValue);
+            if (record) trajectory_start();
+
+            simulate_steps(SIMULATE_UNTIL_COMPLETE);
 
-        while (!is_simulation_complete()) {
-            simulate_step();
+            if (record && !writeTrajectory(recordPath)) {
+                std::cerr << "Can not record the trajectory to " << recordPath << "\n";
+                return 1;
+            }
         }
 
-        metrics.push_back({
+        metrics.add({
             get_makespan(),
             get_e_total(),
             get_e_max(),
             get_t_total(),
             get_t_max(),
             get_available_cells()
-        });
+        }, copies);
 
         reset_simulation();
+        runs += copies;
     }
 
     logMetrics(metrics);
+    if (targetCi > 0) {
+        double width = stopMetric->summary.relativeCiWidth();
+        std::cout << "Sequential Stop:\n";
+        std::cout << "  Simulations: " << runs << "\n";
+        std::cout << "  CI Width:    " << width << " of the mean " << ciMetric
+                  << (width <= targetCi ? " (target reached)" : " (target not reached, --max-n hit)") << "\n";
+    }
+
+    if (profile) {
+        logProfile();
+    }
+    if (PerfCounters::active_phase_counts) {
+        logPerfCounters(perfCounts);
+        g_profiler.phase_hook = nullptr;
+        PerfCounters::active_phase_counts = nullptr;
+    }
 
     return 0;
 }
\ No newline at end of file
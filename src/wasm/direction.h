@@ -0,0 +1,96 @@
+#ifndef DIRECTION_H
+#define DIRECTION_H
+
+// Directions as 3-bit codes. The order is the priority order the robots try the
+// directions in, and every step of it is one Robot::sucDir rotation
+// (right -> up -> forward -> left -> down -> back -> right), so the successor is
+// the next code and the opposite is three codes away. The same codes are sent to
+// the renderer in the direction bits of pop_robot_state (see Direction in types.ts).
+enum Dir : unsigned char {
+    DIR_UP = 0,
+    DIR_FORWARD = 1,
+    DIR_LEFT = 2,
+    DIR_DOWN = 3,
+    DIR_BACK = 4,
+    DIR_RIGHT = 5,
+    DIR_NONE = 7, // No direction, e.g. a robot that has not moved yet
+};
+
+constexpr int DIR_COUNT = 6;
+
+struct DirTables {
+    signed char x[8];
+    signed char y[8];
+    signed char z[8];
+    unsigned char succ[8];
+    unsigned char opposite[8];
+    unsigned char perpendicular[8]; // Bit e is set if direction e is perpendicular to d
+    unsigned char neighbor_index[8]; // Index of the neighbor in a 3x3x3 neighborhood
+    unsigned char axis[8]; // 0 = x, 1 = y, 2 = z
+};
+
+constexpr DirTables make_dir_tables() {
+    DirTables t = {};
+    const signed char offsets[DIR_COUNT][3] = {
+        {0, 1, 0},  // up
+        {0, 0, 1},  // forward
+        {-1, 0, 0}, // left
+        {0, -1, 0}, // down
+        {0, 0, -1}, // back
+        {1, 0, 0},  // right
+    };
+
+    // DIR_NONE (and the unused code 6) behave like the zero vector
+    for (int d = 0; d < 8; d++) {
+        t.succ[d] = DIR_NONE;
+        t.opposite[d] = DIR_NONE;
+        t.perpendicular[d] = 0xff;
+        t.neighbor_index[d] = 13;
+        t.axis[d] = 0;
+    }
+
+    for (int d = 0; d < DIR_COUNT; d++) {
+        t.x[d] = offsets[d][0];
+        t.y[d] = offsets[d][1];
+        t.z[d] = offsets[d][2];
+        t.succ[d] = (d + 1) % DIR_COUNT;
+        t.opposite[d] = (d + 3) % DIR_COUNT;
+        t.neighbor_index[d] = (offsets[d][0] + 1) * 9 + (offsets[d][1] + 1) * 3 + (offsets[d][2] + 1);
+        t.axis[d] = offsets[d][0] != 0 ? 0 : (offsets[d][1] != 0 ? 1 : 2);
+        t.perpendicular[d] = 1 << DIR_NONE;
+        for (int e = 0; e < DIR_COUNT; e++) {
+            int dot = offsets[d][0] * offsets[e][0] + offsets[d][1] * offsets[e][1] + offsets[d][2] * offsets[e][2];
+            if (dot == 0) t.perpendicular[d] |= 1 << e;
+        }
+    }
+    return t;
+}
+
+constexpr DirTables DIR_TABLES = make_dir_tables();
+
+constexpr Dir dir_succ(Dir d) { return (Dir)DIR_TABLES.succ[d]; }
+constexpr Dir dir_opposite(Dir d) { return (Dir)DIR_TABLES.opposite[d]; }
+constexpr bool dir_perpendicular(Dir d, Dir e) { return (DIR_TABLES.perpendicular[d] >> e) & 1; }
+constexpr int dir_neighbor_index(Dir d) { return DIR_TABLES.neighbor_index[d]; }
+constexpr int dir_axis(Dir d) { return DIR_TABLES.axis[d]; }
+
+// The four directions perpendicular to a direction, in priority order
+struct DirQuad {
+    Dir dirs[4];
+};
+
+constexpr DirQuad dir_perpendicular_order(Dir d) {
+    DirQuad quad = {{DIR_NONE, DIR_NONE, DIR_NONE, DIR_NONE}};
+    int count = 0;
+    for (int e = 0; e < DIR_COUNT && count < 4; e++) {
+        if (dir_perpendicular(d, (Dir)e)) quad.dirs[count++] = (Dir)e;
+    }
+    return quad;
+}
+
+static_assert(DIR_TABLES.x[dir_opposite(DIR_LEFT)] == 1, "left and right must be opposite");
+static_assert(dir_succ(DIR_RIGHT) == DIR_UP, "the rotation must wrap around from right to up");
+static_assert(dir_perpendicular(DIR_UP, DIR_LEFT) && !dir_perpendicular(DIR_UP, DIR_DOWN), "perpendicular table");
+static_assert(dir_perpendicular(DIR_NONE, DIR_UP) && dir_perpendicular(DIR_UP, DIR_NONE), "the zero vector is perpendicular to everything");
+
+#endif // DIRECTION_H
@@ -0,0 +1,131 @@
+#ifndef GRID_LAYOUT_H
+#define GRID_LAYOUT_H
+
+// Cell layout policies for the 3D grids (map, distances, robot_field).
+// The policy is picked at compile time with -DGRID_LAYOUT=<id>, every policy
+// maps (x, y, z) to a slot in a flat array and is configured with the current
+// grid dimensions so that only the used part of the storage is touched.
+
+#define GRID_LAYOUT_ROW_MAJOR 0
+#define GRID_LAYOUT_MORTON 1
+#define GRID_LAYOUT_BRICKED 2
+
+#ifndef GRID_LAYOUT
+#define GRID_LAYOUT GRID_LAYOUT_ROW_MAJOR
+#endif
+
+// Plain [x][y][z] order, z is the fastest changing coordinate
+struct RowMajorLayout {
+    static constexpr const char* name = "row-major";
+
+    static constexpr int capacity(int max_size) {
+        return max_size * max_size * max_size;
+    }
+
+    int stride_x = 0;
+    int stride_y = 0;
+    int cells = 0;
+
+    void configure(int size_x, int size_y, int size_z) {
+        stride_y = size_z;
+        stride_x = size_y * size_z;
+        cells = size_x * size_y * size_z;
+    }
+
+    int index(int x, int y, int z) const {
+        return x * stride_x + y * stride_y + z;
+    }
+
+    int extent() const {
+        return cells;
+    }
+};
+
+// Z-order curve, the bits of the three coordinates are interleaved so that
+// cells close in 3D are close in memory as well
+struct MortonLayout {
+    static constexpr const char* name = "morton";
+
+    // Spread the lower 10 bits of v so that there are two zero bits between them
+    static constexpr unsigned spread(unsigned v) {
+        v &= 0x3ff;
+        v = (v | (v << 16)) & 0x030000ff;
+        v = (v | (v << 8)) & 0x0300f00f;
+        v = (v | (v << 4)) & 0x030c30c3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    static constexpr int encode(int x, int y, int z) {
+        return (int)((spread(x) << 2) | (spread(y) << 1) | spread(z));
+    }
+
+    // The code grows with every coordinate, so the far corner has the largest one
+    static constexpr int capacity(int max_size) {
+        return encode(max_size - 1, max_size - 1, max_size - 1) + 1;
+    }
+
+    int cells = 0;
+
+    void configure(int size_x, int size_y, int size_z) {
+        cells = (size_x > 0 && size_y > 0 && size_z > 0) ? encode(size_x - 1, size_y - 1, size_z - 1) + 1 : 0;
+    }
+
+    int index(int x, int y, int z) const {
+        return encode(x, y, z);
+    }
+
+    int extent() const {
+        return cells;
+    }
+};
+
+// 4x4x4 bricks stored one after the other, row-major inside a brick and
+// row-major between the bricks. One brick is 64 cells, so a 3x3x3 neighborhood
+// touches at most 8 bricks.
+struct BrickedLayout {
+    static constexpr const char* name = "bricked";
+    static constexpr int BRICK_BITS = 2;
+    static constexpr int BRICK_SIZE = 1 << BRICK_BITS;
+    static constexpr int BRICK_CELLS = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+
+    static constexpr int bricks(int size) {
+        return (size + BRICK_SIZE - 1) / BRICK_SIZE;
+    }
+
+    static constexpr int capacity(int max_size) {
+        return bricks(max_size) * bricks(max_size) * bricks(max_size) * BRICK_CELLS;
+    }
+
+    int bricks_y = 0;
+    int bricks_z = 0;
+    int cells = 0;
+
+    void configure(int size_x, int size_y, int size_z) {
+        bricks_y = bricks(size_y);
+        bricks_z = bricks(size_z);
+        cells = bricks(size_x) * bricks_y * bricks_z * BRICK_CELLS;
+    }
+
+    int index(int x, int y, int z) const {
+        int brick = ((x >> BRICK_BITS) * bricks_y + (y >> BRICK_BITS)) * bricks_z + (z >> BRICK_BITS);
+        int local = ((x & (BRICK_SIZE - 1)) << (2 * BRICK_BITS)) | ((y & (BRICK_SIZE - 1)) << BRICK_BITS) | (z & (BRICK_SIZE - 1));
+        return brick * BRICK_CELLS + local;
+    }
+
+    int extent() const {
+        return cells;
+    }
+};
+
+#if GRID_LAYOUT == GRID_LAYOUT_ROW_MAJOR
+using GridLayout = RowMajorLayout;
+#elif GRID_LAYOUT == GRID_LAYOUT_MORTON
+using GridLayout = MortonLayout;
+#elif GRID_LAYOUT == GRID_LAYOUT_BRICKED
+using GridLayout = BrickedLayout;
+#else
+#error "Unknown GRID_LAYOUT"
+#endif
+
+#endif // GRID_LAYOUT_H
@@ -0,0 +1,111 @@
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "main.cpp" // Unity build, the grid layout is chosen with -DGRID_LAYOUT
+#include "mapgen.h"
+
+// Grid layout comparison on generated column-tree maps. Every layout is a
+// separate binary, `make bench-layout` builds all of them and runs them under
+// `perf stat` (when available) to also report the cache misses.
+
+using BenchClock = std::chrono::steady_clock;
+
+void printHelp() {
+    std::cout << "Usage: layout_bench [options]\n";
+    std::cout << "Options:\n";
+    std::cout << "  -h, --help           Show this help message\n";
+    std::cout << "  --sizes <a,b,...>    Cube side lengths of the generated maps (max " << MAX_SIZE << ")\n";
+    std::cout << "  --steps <n>          Simulation steps measured per map\n";
+    std::cout << "  --repeats <n>        Neighborhood sweeps per map\n";
+    std::cout << "  --seed <n>           Seed of the map generator\n";
+}
+
+double elapsedNs(BenchClock::time_point start) {
+    return std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<int> sizes = {16, 32, 48, 64};
+    int steps = 200;
+    int repeats = 5;
+    unsigned seed = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printHelp();
+            return 0;
+        } else if (arg == "--sizes" && i + 1 < argc) {
+            sizes.clear();
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                sizes.push_back(std::stoi(item));
+            }
+        } else if (arg == "--steps" && i + 1 < argc) {
+            steps = std::stoi(argv[++i]);
+        } else if (arg == "--repeats" && i + 1 < argc) {
+            repeats = std::stoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            printHelp();
+            return 1;
+        }
+    }
+
+    std::cout << "Grid layout: " << GridLayout::name << " (capacity " << GRID_CAPACITY << " cells)\n";
+    std::cout << "size\tcells\twalkable\tgather_ns\tstep_us\n";
+
+    for (int size : sizes) {
+        if (size > MAX_SIZE) {
+            std::cerr << "Skipping size " << size << ", the binary was built with GRID_MAX_SIZE=" << MAX_SIZE << "\n";
+            continue;
+        }
+
+        MapGen::GeneratedMap generated = MapGen::columnTree(size, size, size, 0.5, seed);
+        load_map_info(generated.info());
+        set_active_probability(100);
+
+        // Gather the neighborhood of every walkable cell, this is the access
+        // pattern that depends on the layout the most
+        std::vector<Vector3Int> cells;
+        for (int x = 0; x < height; x++) {
+            for (int y = 0; y < width; y++) {
+                for (int z = 0; z < depth; z++) {
+                    if (map(x, y, z)) cells.push_back(Vector3Int(x, y, z));
+                }
+            }
+        }
+
+        array<CellState, 3*3*3> neighbors;
+        int checksum = 0;
+        auto gather_start = BenchClock::now();
+        for (int r = 0; r < repeats; r++) {
+            for (const Vector3Int& cell : cells) {
+                generateNeighbors(cell.x, cell.y, cell.z, neighbors);
+                checksum += neighbors[13];
+            }
+        }
+        double gather_ns = elapsedNs(gather_start) / (double)(cells.size() * repeats);
+
+        // Full simulation steps from a fresh map
+        auto step_start = BenchClock::now();
+        int executed = 0;
+        while (executed < steps && !is_simulation_complete()) {
+            simulate_step();
+            executed++;
+        }
+        double step_us = executed > 0 ? elapsedNs(step_start) / 1000.0 / executed : 0.0;
+
+        std::cout << size << "\t" << (long long)size * size * size << "\t" << cells.size() << "\t"
+                  << gather_ns << "\t" << step_us << "\n";
+
+        if (checksum < 0) std::cout << checksum << "\n";
+    }
+
+    return 0;
+}
@@ -1,6 +1,15 @@
 #include "maps.h"
+#include "grid_layout.h"
+#include "direction.h"
+#include "profiler.h"
+#include "trajectory.h"
+
+// Largest grid side length, native benchmark builds raise it with -DGRID_MAX_SIZE=<n>
+#ifndef GRID_MAX_SIZE
+#define GRID_MAX_SIZE 20
+#endif
 
-constexpr int MAX_SIZE = 20;
+constexpr int MAX_SIZE = GRID_MAX_SIZE;
 constexpr int MAX_ROBOTS = MAX_SIZE * MAX_SIZE * MAX_SIZE;
 constexpr int MAX_QUEUE_SIZE = MAX_ROBOTS;
 constexpr int INT_MAX = 2147483647;
@@ -164,10 +173,8 @@ extern "C" int randomInt(int min, int max);
 using std::array;
 using std::strlen;
 
-// Define an alias for abs to ensure consistency with the custom implementation
-inline int abs(int n) {
-    return std::abs(n);
-}
+// Use the libc abs, redefining it here would recurse into itself on libstdc++
+using std::abs;
 
 extern "C" void console_log(int value) {
     // Placeholder for console logging
@@ -187,6 +194,9 @@ enum CellState {
     FREE
 };
 
+// Bit mask neighborhoods and the gather kernels, they use the CellState values
+#include "neighborhood.h"
+
 // 3D Vector implementation
 struct Vector3Int {
     int x, y, z;
@@ -234,6 +244,12 @@ struct Queue {
     bool empty() {
         return size == 0;
     }
+
+    void clear() {
+        front = 0;
+        rear = -1;
+        size = 0;
+    }
     
     void push(Vector3Int item) {
         if (size < MAX_QUEUE_SIZE) {
@@ -252,19 +268,21 @@ struct Queue {
 };
 
 // Static Vector3Int constants
-static Vector3Int up;
-static Vector3Int down;
-static Vector3Int left;
-static Vector3Int right;
-static Vector3Int forward;
-static Vector3Int back;
 static Vector3Int zero;
 
+// Unit vector of a direction code
+Vector3Int dirOffset(Dir d) {
+    return Vector3Int(DIR_TABLES.x[d], DIR_TABLES.y[d], DIR_TABLES.z[d]);
+}
+
 // Min function since we can't use std::min
 int min_int(int a, int b) {
     return a < b ? a : b;
 }
 
+// External direction given to the robots created from now on, see set_external_direction
+static Dir g_external_direction = DIR_UP;
+
 // Robot class
 class Robot {
 public:
@@ -272,24 +290,24 @@ public:
     Vector3Int position;
     Vector3Int target;
     Vector3Int target2 = zero;
-    Vector3Int kulso_irany;   // External direction (from C# code)
-    Vector3Int primary_dir;   // Primary direction value
-    Vector3Int secondary_dir; // Secondary direction value
-    Vector3Int last_move;
+    Dir kulso_irany;   // External direction (from C# code)
+    Dir primary_dir;   // Primary direction value
+    Dir secondary_dir; // Secondary direction value
+    Dir last_move;
     bool sleeping;
     bool ever_moved;
     int active_for;
-    array<CellState, 3*3*3> neighbors_tmp; // Neighbors state (3x3x3)
+    Neighborhood neighbors_tmp; // Neighbors state (3x3x3)
     bool active;
     int settled_for; // For rendering as wall
     
     Robot(): 
         position(zero),
         target(zero),
-        kulso_irany(up),
-        primary_dir(zero),
-        secondary_dir(zero),
-        last_move(zero),
+        kulso_irany(g_external_direction),
+        primary_dir(DIR_NONE),
+        secondary_dir(DIR_NONE),
+        last_move(DIR_NONE),
         ever_moved(false),
         active_for(0),
         active(false),
@@ -298,10 +316,10 @@ public:
     Robot(Vector3Int pos):
         position(pos),
         target(pos),
-        kulso_irany(up),
-        primary_dir(zero),
-        secondary_dir(zero),
-        last_move(zero),
+        kulso_irany(g_external_direction),
+        primary_dir(DIR_NONE),
+        secondary_dir(DIR_NONE),
+        last_move(DIR_NONE),
         ever_moved(false),
         active_for(0),
         active(true),   // Set to true by default - robots should be active when created
@@ -309,39 +327,15 @@ public:
 
 
     // Get the compatible directions
-    array<Vector3Int, 4> getCompatibleDirs(const Vector3Int& dir) {
-        array<Vector3Int, 4> directions;
-        directions[0] = sucDir(dir);
-        directions[1] = sucDir(directions[0]);
-        directions[2] = sucDir(sucDir(sucDir(dir)));
-        directions[3] = sucDir(directions[2]);
-        return directions;
-    }
-    
-        
-    // Get all possible directions
-    const array<Vector3Int, 6>& getAllDirections() {
-        static array<Vector3Int, 6> directions;
-        directions[0] = up;
-        directions[1] = forward;
-        directions[2] = left;
-        directions[3] = down;
-        directions[4] = back;
-        directions[5] = right;
+    array<Dir, 4> getCompatibleDirs(Dir dir) {
+        array<Dir, 4> directions;
+        directions[0] = dir_succ(dir);
+        directions[1] = dir_succ(directions[0]);
+        directions[2] = dir_succ(dir_succ(dir_succ(dir)));
+        directions[3] = dir_succ(directions[2]);
         return directions;
     }
 
-    // Get next direction in cycle
-    Vector3Int sucDir(const Vector3Int& d) {
-        if (d.x == 1 && d.y == 0 && d.z == 0) return Vector3Int(0, 1, 0);
-        if (d.x == 0 && d.y == 1 && d.z == 0) return Vector3Int(0, 0, 1);
-        if (d.x == 0 && d.y == 0 && d.z == 1) return Vector3Int(-1, 0, 0);
-        if (d.x == -1 && d.y == 0 && d.z == 0) return Vector3Int(0, -1, 0);
-        if (d.x == 0 && d.y == -1 && d.z == 0) return Vector3Int(0, 0, -1);
-        if (d.x == 0 && d.y == 0 && d.z == -1) return Vector3Int(1, 0, 0);
-        return Vector3Int(0, 0, 0);
-    }
-
     int neighbors_index(const Vector3Int& rel_coords) {
         return (rel_coords.x + 1) * 9 + (rel_coords.y + 1) * 3 + (rel_coords.z + 1);
     }
@@ -351,83 +345,55 @@ public:
     }
 
     // Get relative cell state from neighbors
-    CellState getRelative(const Vector3Int& rel_coords) {
-        int index = neighbors_index(rel_coords);
-        return neighbors_tmp[index];
+    CellState getRelative(Dir dir) {
+        return neighbors_tmp.at(dir_neighbor_index(dir));
     }
 
     // Set next move direction
-    void setNextMoveDir(const Vector3Int& rel_coords) {
-        if(getRelative(rel_coords) == FREE){
+    void setNextMoveDir(Dir dir) {
+        if(getRelative(dir) == FREE){
             ever_moved = true;
-            last_move = rel_coords;
-            target = position + rel_coords;
+            last_move = dir;
+            target = position + dirOffset(dir);
         }
         
-        // console_log(neighbors_index(rel_coords));
+        // console_log(dir_neighbor_index(dir));
 
         // console_log(target.x);
         // console_log(target.y);
         // console_log(target.z);
-        // console_log(last_move.x);
-        // console_log(last_move.y);
-        // console_log(last_move.z);
-    }
-
-    // Check if two points are reachable
-    bool reachable(const Vector3Int& from, const Vector3Int& to, array<CellState, 3*3*3>& neighbors) {
-        int from_index = neighbors_index(from);
-        int to_index = neighbors_index(to);
-        if (neighbors[from_index] == WALL || neighbors[to_index] == WALL) return false;
-        
-        bool reach[3][3][3] = {};
-        reach[from.x+1][from.y+1][from.z+1] = true;
-        
-        bool change;
-        do {
-            change = false;
-            for (int i = 0; i < 3; i++) {
-                for (int j = 0; j < 3; j++) {
-                    for (int k = 0; k < 3; k++) {
-                        for (int i2 = 0; i2 < 3; i2++) {
-                            for (int j2 = 0; j2 < 3; j2++) {
-                                for (int k2 = 0; k2 < 3; k2++) {
-                                    if (abs(i - i2) <= 1 && abs(j - j2) <= 1 && abs(k - k2) <= 1 &&
-                                        abs(i - i2) + abs(j - j2) + abs(k - k2) == 1) {
-                                        int index = i2 * 9 + j2 * 3 + k2;
-                                        if (reach[i][j][k] && !reach[i2][j2][k2] && neighbors[index] != WALL) {
-                                            reach[i2][j2][k2] = true;
-                                            change = true;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        } while (change);
-        
-        return reach[to.x+1][to.y+1][to.z+1];
-    }
-
-    // Calculate dot product of two vectors
-    int dot(const Vector3Int& v1, const Vector3Int& v2) {
-        return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+        // console_log(last_move);
+    }
+
+    // Check if settling would cut any path between two non-center cells, the
+    // center is open now and becomes a wall once the robot settles
+    bool settlingBlocksPath(unsigned walls) {
+        unsigned open_now = (NEIGHBORHOOD_ALL & ~walls) | NEIGHBORHOOD_CENTER_BIT;
+        unsigned open_later = open_now & ~NEIGHBORHOOD_CENTER_BIT;
+        for (int from = 0; from < 27; from++) {
+            unsigned from_bit = 1u << from;
+            if (from == NEIGHBORHOOD_CENTER || !(open_later & from_bit)) continue;
+            PROFILE_COUNT(COUNTER_REACHABLE, 2);
+            unsigned reach_now = neighborhood_flood(from_bit, open_now);
+            unsigned reach_later = neighborhood_flood(from_bit, open_later);
+            if (reach_now & ~reach_later & ~NEIGHBORHOOD_CENTER_BIT) return true;
+        }
+        return false;
     }
 
     // Initialize primary direction
     void initPrimary() {
-        primary_dir = zero; // Reset primary direction
-        secondary_dir = zero; // Reset secondary direction
+        primary_dir = DIR_NONE; // Reset primary direction
+        secondary_dir = DIR_NONE; // Reset secondary direction
     
-        for(const auto& dir : getAllDirections()) {
-            if (dot(dir, kulso_irany) == 0 && dir != -last_move) {
+        for (int d = 0; d < DIR_COUNT; d++) {
+            Dir dir = (Dir)d;
+            if (dir_perpendicular(dir, kulso_irany) && dir != dir_opposite(last_move)) {
                 if (getRelative(dir) == FREE || getRelative(dir) == OCCUPIED) {
                     primary_dir = dir;
-                    secondary_dir = sucDir(primary_dir);
-                    while(dot(secondary_dir, kulso_irany) != 0) {
-                        secondary_dir = sucDir(secondary_dir);
+                    secondary_dir = dir_succ(primary_dir);
+                    while(!dir_perpendicular(secondary_dir, kulso_irany)) {
+                        secondary_dir = dir_succ(secondary_dir);
                     }
                     break; // Exit after finding the first valid direction
                 }
@@ -435,16 +401,33 @@ public:
         }
     }
 
-    // The main decision function for robot movement
-    void lookCompute(array<CellState, 3 * 3 * 3>& neighbors, array<CellState, 3 * 3 * 3>& neighbors2, const int tav) {
+    // The main decision function for robot movement, dispatches on the external direction
+    void lookCompute(const Neighborhood& neighbors, const int tav) {
+        switch (kulso_irany) {
+            case DIR_FORWARD: lookComputeOriented<DIR_FORWARD>(neighbors, tav); break;
+            case DIR_LEFT: lookComputeOriented<DIR_LEFT>(neighbors, tav); break;
+            case DIR_DOWN: lookComputeOriented<DIR_DOWN>(neighbors, tav); break;
+            case DIR_BACK: lookComputeOriented<DIR_BACK>(neighbors, tav); break;
+            case DIR_RIGHT: lookComputeOriented<DIR_RIGHT>(neighbors, tav); break;
+            default: lookComputeOriented<DIR_UP>(neighbors, tav); break;
+        }
+    }
+
+    // lookCompute for one external direction, "up" is Ext and "down" is its opposite
+    template<Dir Ext>
+    void lookComputeOriented(const Neighborhood& neighbors, const int tav) {
+        constexpr Dir ext_down = dir_opposite(Ext);
+        constexpr DirQuad sideways = dir_perpendicular_order(Ext);
+
+        PROFILE_COUNT(COUNTER_ACTIVATIONS, 1);
         active_for++;
 
         neighbors_tmp = neighbors;
 
         bool block_all = true;
         
-        for (const auto& dir : getAllDirections()) {
-            if (getRelative(dir) != WALL) {
+        for (int d = 0; d < DIR_COUNT; d++) {
+            if (getRelative((Dir)d) != WALL) {
                 block_all = false;
                 break;
             }
@@ -456,58 +439,17 @@ public:
         }
 
         // Trying to settle
-        bool can_settle = ever_moved && (getRelative(up) == WALL || getRelative(down) == WALL) &&
-                                        (getRelative(right) == WALL || getRelative(left) == WALL) &&
-                                        (getRelative(forward) == WALL || getRelative(back) == WALL);
-
-        // Make the top and bottom layers walls in neighbors2
-        for (int i = 0; i <= 2; i++) {
-            for (int j = 0; j <= 2; j++) {
-                int idx1 = i * 9 + 0 * 3 + j;
-                int idx2 = i * 9 + 2 * 3 + j;
-                neighbors2[idx1] = WALL;
-                neighbors2[idx2] = WALL;
-            }
-        }
+        bool can_settle = ever_moved && (getRelative(DIR_UP) == WALL || getRelative(DIR_DOWN) == WALL) &&
+                                        (getRelative(DIR_RIGHT) == WALL || getRelative(DIR_LEFT) == WALL) &&
+                                        (getRelative(DIR_FORWARD) == WALL || getRelative(DIR_BACK) == WALL);
 
-        // Check if settling would block any paths
-        for (int i = 0; i <= 2; i++) {
-            for (int j = 0; j <= 2; j++) {
-                for (int k = 0; k <= 2; k++) {
-                    for (int i2 = 0; i2 <= 2; i2++) {
-                        for (int j2 = 0; j2 <= 2; j2++) {
-                            for (int k2 = 0; k2 <= 2; k2++) {
-                                // Skip checks involving the center cell (where the robot is)
-                                if (i == 1 && j == 1 && k == 1) continue;
-                                if (i2 == 1 && j2 == 1 && k2 == 1) continue;
-
-                                Vector3Int from(i - 1, j - 1, k - 1);
-                                Vector3Int to(i2 - 1, j2 - 1, k2 - 1);
-                                
-                                // Check with original neighbors
-                                bool can_traverse_now = reachable(from, to, neighbors);
-                                int center_idx = neighbors_index(0, 0, 0);
-                                neighbors[center_idx] = WALL;
-                                bool can_traverse_later = reachable(from, to, neighbors);
-                                neighbors[center_idx] = OCCUPIED;
-
-                                if (can_traverse_now && !can_traverse_later) {
-                                    can_settle = false;
-                                }
-                                
-                                can_traverse_now = reachable(from, to, neighbors2);
-                                center_idx = neighbors_index(0, 0, 0);
-                                neighbors2[center_idx] = WALL;
-                                can_traverse_later = reachable(from, to, neighbors2);
-                                neighbors2[center_idx] = OCCUPIED;
-                                
-                                if (can_traverse_now && !can_traverse_later) {
-                                    can_settle = false;
-                                }
-                            }
-                        }
-                    }
-                }
+        // Settling must not disconnect the neighborhood, neither as it is nor
+        // with the top and bottom layers (along Ext) turned into walls
+        if (can_settle) {
+            PROFILE_COUNT(COUNTER_SETTLE_CHECKS, 1);
+            constexpr unsigned sealed_layers = neighborhood_layer(dir_axis(Ext), 0) | neighborhood_layer(dir_axis(Ext), 2);
+            if (settlingBlocksPath(neighbors.wall) || settlingBlocksPath(neighbors.wall | sealed_layers)) {
+                can_settle = false;
             }
         }
 
@@ -520,13 +462,14 @@ public:
             return;
         }
 
-        if(last_move != down && (getRelative(up) == FREE || getRelative(up) == OCCUPIED)){
-            setNextMoveDir(up);
+        if(last_move != ext_down && (getRelative(Ext) == FREE || getRelative(Ext) == OCCUPIED)){
+            setNextMoveDir(Ext);
             return;
         }
     
-        for(const auto& dir : getAllDirections()) {
-            if (dot(dir, kulso_irany) == 0 && dir != -last_move) {
+        for (int i = 0; i < 4; i++) {
+            Dir dir = sideways.dirs[i];
+            if (dir != dir_opposite(last_move)) {
                 if (getRelative(dir) == FREE || getRelative(dir) == OCCUPIED) {
                     setNextMoveDir(dir);
                     return;
@@ -534,7 +477,7 @@ public:
             }
         }
         
-        setNextMoveDir(down);
+        setNextMoveDir(ext_down);
     }
 
     // Move the robot to its target
@@ -547,13 +490,41 @@ public:
 
 // a generic method to be able to get the change between this and the next step
 // We will have one diff per robot
-enum class RobotState {
+enum class RobotState : unsigned char {
     IDLE = 0, // Could not move 
     ACTIVE = 1, // Looking for a move
     SETTLED = 2, // Settled
 };
 
-RobotState prev_robot_states[MAX_ROBOTS], curr_robot_states[MAX_ROBOTS];
+// Cells of the grid storage, enough for the largest grid in any layout
+constexpr int GRID_CAPACITY = GridLayout::capacity(MAX_SIZE);
+// Side of the byte field of the cell states, the grid with a wall border (see CellStateField)
+constexpr int CELL_STATE_SIDE = MAX_SIZE + 2;
+// Entries of the dirty cell ring (see dirty_cells)
+constexpr int DIRTY_CELL_CAPACITY = 1 << 14;
+
+// The large per simulation arrays. Every engine context owns one, the globals
+// below point into the storage of the selected context (see select_context).
+struct EngineStorage {
+    Robot robots[MAX_ROBOTS];
+    RobotState prev_robot_states[MAX_ROBOTS];
+    RobotState curr_robot_states[MAX_ROBOTS];
+    int robot_steps[MAX_ROBOTS];
+    int robot_time[MAX_ROBOTS];
+    bool map[GRID_CAPACITY];
+    int distances[GRID_CAPACITY];
+    Robot* robot_field[GRID_CAPACITY];
+    // The 4 extra bytes let the last row be read with a 4 byte load
+    unsigned char cell_states[CELL_STATE_SIDE * CELL_STATE_SIDE * CELL_STATE_SIDE + 4];
+    unsigned char render_cells[MAX_SIZE * MAX_SIZE * MAX_SIZE];
+    unsigned dirty_cells[DIRTY_CELL_CAPACITY];
+};
+
+// Storage of the first context, the only one unless more are created
+EngineStorage engine_storage;
+
+RobotState* prev_robot_states = engine_storage.prev_robot_states;
+RobotState* curr_robot_states = engine_storage.curr_robot_states;
 
 // Simulation metrics for tracking
 int available_cells = 0;      // Number of walkable cells (n)
@@ -566,9 +537,9 @@ int simulation_steps = 0;     // Number of steps in the simulation
 bool simulation_complete = false; // Flag to indicate all robots have settled
 
 // Track steps taken by each robot (for t_max and t_total)
-int robot_steps[MAX_ROBOTS] = {0};
+int* robot_steps = engine_storage.robot_steps;
 // Track time spent by each robot (for e_max and e_total)
-int robot_time[MAX_ROBOTS] = {0};
+int* robot_time = engine_storage.robot_time;
 
 void initialize_robot_states() {
     for (int i = 0; i < MAX_ROBOTS; ++i) {
@@ -581,17 +552,69 @@ void initialize_robot_states() {
 int width = 3;
 int height = 4;
 int depth = 4;
-bool map[MAX_SIZE][MAX_SIZE][MAX_SIZE];
-int distances[MAX_SIZE][MAX_SIZE][MAX_SIZE];
-Robot* robot_field[MAX_SIZE][MAX_SIZE][MAX_SIZE];
-Robot robots[MAX_ROBOTS];
+
+// All grids have the same dimensions, so they share one configured layout
+GridLayout grid_layout;
+
+// Dense 3D grid, the cells are stored in the order of the compile time layout policy
+template<typename T>
+struct Grid {
+    T* cells; // GRID_CAPACITY cells in the storage of the selected context
+
+    T& operator()(int x, int y, int z) {
+        return cells[grid_layout.index(x, y, z)];
+    }
+
+    const T& operator()(int x, int y, int z) const {
+        return cells[grid_layout.index(x, y, z)];
+    }
+
+    // Only clear the part of the storage used by the current dimensions
+    void clear() {
+        memset(cells, 0, sizeof(T) * grid_layout.extent());
+    }
+};
+
+Grid<bool> map{engine_storage.map};
+Grid<int> distances{engine_storage.distances};
+Grid<Robot*> robot_field{engine_storage.robot_field};
+
+// Byte copy of getCellState for the vectorized neighborhood gather. It is always
+// row-major with a wall border, so a 3x3x3 gather is 9 short rows without bounds checks.
+struct CellStateField {
+    unsigned char* cells; // In the storage of the selected context
+    int stride_x = 0;
+    int stride_y = 0;
+    int cell_count = 0;
+
+    void configure(int size_x, int size_y, int size_z) {
+        stride_y = size_z + 2;
+        stride_x = (size_y + 2) * stride_y;
+        cell_count = (size_x + 2) * stride_x;
+    }
+
+    unsigned char& operator()(int x, int y, int z) {
+        return cells[(x + 1) * stride_x + (y + 1) * stride_y + (z + 1)];
+    }
+
+    // The (-1, -1, -1) corner of the neighborhood of (x, y, z)
+    const unsigned char* corner(int x, int y, int z) const {
+        return cells + x * stride_x + y * stride_y + z;
+    }
+};
+
+CellStateField cell_states{engine_storage.cell_states};
+Robot* robots = engine_storage.robots;
 int robot_count = 0;
 Vector3Int start_pos(0, 0, 0);
 int last_loaded_map_index = 0; // Store the last loaded map index
+// Bumped by every call that can change the walls or the door
+int layout_version = 0;
 
 
 // Set start position
 extern "C" void set_start_position(int x, int y, int z) {
+    layout_version++;
     start_pos = Vector3Int(z, y, x);
 }
 
@@ -601,13 +624,13 @@ extern "C" CellState getCellState(int x, int y, int z) {
     if (x < 0 || y < 0 || z < 0 || x >= height || y >= width || z >= depth) {
         return WALL;
     }
-    // If map[x][y][z] is false, it's a wall (not walkable)
-    if (!map[x][y][z] || (robot_field[x][y][z] != nullptr && !robot_field[x][y][z]->active)) {
+    // If map(x, y, z) is false, it's a wall (not walkable)
+    if (!map(x, y, z) || (robot_field(x, y, z) != nullptr && !robot_field(x, y, z)->active)) {
         return WALL;
     }
 
     // If an active robot is here, it's occupied
-    if (robot_field[x][y][z] != nullptr) {
+    if (robot_field(x, y, z) != nullptr) {
         return OCCUPIED;
     }
     // Otherwise, it's free and walkable
@@ -627,10 +650,59 @@ extern "C" void generateNeighbors(int x, int y, int z, array<CellState, 3*3*3> &
     }
 }
 
+// Refresh one cell of the byte field after a robot settled there
+void refresh_cell_state(int x, int y, int z) {
+    cell_states(x, y, z) = (unsigned char)getCellState(x, y, z);
+}
+
+// Rebuild the byte field, the map and the robot field may have been edited since the last step
+void refresh_cell_states() {
+    cell_states.configure(height, width, depth);
+    memset(cell_states.cells, WALL, cell_states.cell_count + 4);
+    // Same states as getCellState, read through locals: the byte stores may alias
+    // any global, so the grid pointers would be reloaded for every cell otherwise
+    const GridLayout layout = grid_layout;
+    const bool* walkable = map.cells;
+    Robot* const* field = robot_field.cells;
+    const CellStateField states = cell_states;
+    for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+            unsigned char* row = states.cells + (x + 1) * states.stride_x + (y + 1) * states.stride_y + 1;
+            for (int z = 0; z < depth; z++) {
+                int cell = layout.index(x, y, z);
+                const Robot* robot = field[cell];
+                CellState state = FREE;
+                if (!walkable[cell] || (robot != nullptr && !robot->active)) state = WALL;
+                else if (robot != nullptr) state = OCCUPIED;
+                row[z] = (unsigned char)state;
+            }
+        }
+    }
+}
+
+// Gather and classify the neighborhood of a cell from the byte field
+Neighborhood gatherNeighborhood(int x, int y, int z) {
+    return gather_neighborhood(cell_states.corner(x, y, z), cell_states.stride_x, cell_states.stride_y);
+}
+
+// Reference version built from getCellState, used to test the kernels
+Neighborhood gatherNeighborhoodScalar(int x, int y, int z) {
+    array<CellState, 3*3*3> states;
+    generateNeighbors(x, y, z, states);
+
+    Neighborhood result = {0, 0, 0};
+    for (int i = 0; i < 3*3*3; i++) {
+        if (states[i] == WALL) result.wall |= 1u << i;
+        else if (states[i] == OCCUPIED) result.occupied |= 1u << i;
+        else result.free |= 1u << i;
+    }
+    return result;
+}
+
 // Generate the robot field based on current positions
 extern "C" void generateRobotField() {
     // Clear the robot field first
-    memset(robot_field, 0, sizeof(robot_field));
+    robot_field.clear();
     
     for (int i = 0; i < robot_count; i++) {
         Robot& robot = robots[i];
@@ -638,22 +710,25 @@ extern "C" void generateRobotField() {
         int y = robot.position.y;
         int z = robot.position.z;
         
-        if (robot_field[x][y][z] == nullptr) {
-            if (map[x][y][z]) {
-                robot_field[x][y][z] = &robot;
+        if (robot_field(x, y, z) == nullptr) {
+            if (map(x, y, z)) {
+                robot_field(x, y, z) = &robot;
             } else {
                 //console_log(5000 + i); // Log: Robot position is not walkable
                 //console_log(666);
             }
         } else {
-            // Log the collision: robot tried to occupy a position already occupied by robot_field[x][y][z]
-            //console_log(10000 + i * 100 + (robot_field[x][y][z] - robots)); // Log: Robots collided
+            PROFILE_COUNT(COUNTER_COLLISIONS, 1);
+            // Log the collision: robot tried to occupy a position already occupied by robot_field(x, y, z)
+            //console_log(10000 + i * 100 + (robot_field(x, y, z) - robots)); // Log: Robots collided
             //console_log(666);
 
         }
     }
 }
 
+Queue bfs_queue;
+
 // BFS to calculate distances from start position
 extern "C" void bfs() {
     // Initialize distances and count available cells
@@ -661,48 +736,263 @@ extern "C" void bfs() {
     for (int i = 0; i < height; i++) {
         for (int j = 0; j < width; j++) {
             for (int k = 0; k < depth; k++) {
-                distances[i][j][k] = INT_MAX;
-                if (map[i][j][k]) {
+                distances(i, j, k) = INT_MAX;
+                if (map(i, j, k)) {
                     available_cells++; // Count walkable cells
                 }
             }
         }
     }
     
-    // Use our custom queue for BFS
-    Queue q;
-    distances[start_pos.x][start_pos.y][start_pos.z] = 0;
+    // Use our custom queue for BFS, it is global as it is too large for the stack on big grids
+    Queue& q = bfs_queue;
+    q.clear();
+    distances(start_pos.x, start_pos.y, start_pos.z) = 0;
     q.push(start_pos);
     
-    const Vector3Int directions[6] = {up, down, back, forward, left, right};
     while (!q.empty()) {
         Vector3Int v = q.pop();
         
         
-        for (int i = 0; i < 6; i++) {
-            Vector3Int next = v + directions[i];
+        for (int d = 0; d < DIR_COUNT; d++) {
+            Vector3Int next = v + dirOffset((Dir)d);
             
             if (next.x < 0 || next.x >= height) continue;
             if (next.y < 0 || next.y >= width) continue;
             if (next.z < 0 || next.z >= depth) continue;
-            if (distances[next.x][next.y][next.z] != INT_MAX) continue;
-            if (!map[next.x][next.y][next.z]) continue;
+            if (distances(next.x, next.y, next.z) != INT_MAX) continue;
+            if (!map(next.x, next.y, next.z)) continue;
             
-            distances[next.x][next.y][next.z] = distances[v.x][v.y][v.z] + 1;
+            distances(next.x, next.y, next.z) = distances(v.x, v.y, v.z) + 1;
             q.push(next);
         }
     }
 }
 
+// Render code of a cell inside the grid: 0 empty, 1 wall, 2 robot, 3 settled robot,
+// 4 door, 5 sleeping robot
+static inline int render_cell_code(int x, int y, int z) {
+    // Important: Door position is special - always render as DOOR (4), even if a robot is here
+    // This ensures the door is always visible and robots can still spawn here
+    if (x == start_pos.x && y == start_pos.y && z == start_pos.z) {
+        return 4;
+    }
+
+    const Robot* robot = robot_field(x, y, z);
+    if (robot != nullptr) {
+        if (robot->active) {
+            return robot->sleeping ? 5 : 2;
+        }
+        // Settled robots keep their color, no matter how long ago they settled
+        return 3;
+    }
+
+    // Walkable space (but not door or robot) -> Empty, not walkable -> Wall
+    return map(x, y, z) ? 0 : 1;
+}
+
+// Render codes of the whole grid, one byte per cell in x, y, z order (z fastest)
+unsigned char* render_cells = engine_storage.render_cells;
+
+// Cells whose render code changed in simulate_step, so a renderer can patch its
+// instances instead of reading the whole grid. The entries are relative to the
+// last export_cells and are only written after one: (cell index << 3) | code,
+// cell index as in render_cells. The head counts all entries ever written, a
+// reader that is more than DIRTY_CELL_CAPACITY behind (or that saw an engine
+// change outside of simulate_step) has to export the whole grid again.
+unsigned* dirty_cells = engine_storage.dirty_cells;
+int dirty_cell_head = 0;
+bool dirty_cells_tracking = false;
+
+// Robots that were active at the start of the step and their cells, only they can change a cell
+int dirty_robot_count = 0;
+int dirty_robot_index[MAX_ROBOTS];
+Vector3Int dirty_robot_position[MAX_ROBOTS];
+int dirty_spawn_from = 0;
+
+// The cells changed without simulate_step, readers have to export the whole grid
+void dirty_cells_invalidate() {
+    if (!dirty_cells_tracking) return;
+    dirty_cells_tracking = false;
+    dirty_cell_head += DIRTY_CELL_CAPACITY + 1;
+}
+
+void dirty_cells_begin_step() {
+    dirty_robot_count = 0;
+    for (int i = 0; i < robot_count; i++) {
+        if (!robots[i].active) continue;
+        dirty_robot_index[dirty_robot_count] = i;
+        dirty_robot_position[dirty_robot_count] = robots[i].position;
+        dirty_robot_count++;
+    }
+    dirty_spawn_from = robot_count;
+}
+
+void dirty_cells_check(const Vector3Int& position) {
+    int index = (position.x * width + position.y) * depth + position.z;
+    unsigned char code = (unsigned char)render_cell_code(position.x, position.y, position.z);
+    if (render_cells[index] == code) return;
+    render_cells[index] = code;
+    dirty_cells[dirty_cell_head % DIRTY_CELL_CAPACITY] = ((unsigned)index << 3) | code;
+    dirty_cell_head++;
+}
+
+// Cells a robot left or entered and the cells of the spawned robots. A cell that
+// is checked twice is written once, the second check sees the updated code.
+void dirty_cells_end_step() {
+    for (int i = 0; i < dirty_robot_count; i++) {
+        dirty_cells_check(dirty_robot_position[i]);
+        dirty_cells_check(robots[dirty_robot_index[i]].position);
+    }
+    for (int i = dirty_spawn_from; i < robot_count; i++) {
+        dirty_cells_check(robots[i].position);
+    }
+}
+
+extern "C" unsigned* get_dirty_cells() {
+    return dirty_cells;
+}
+
+extern "C" int get_dirty_cell_capacity() {
+    return DIRTY_CELL_CAPACITY;
+}
+
+extern "C" int get_dirty_cell_head() {
+    return dirty_cell_head;
+}
+
+// Fills render_cells with the get_cell code of every cell and returns it, so a
+// frame is a single call and JS reads the codes through one Uint8Array view.
+// The dirty cell entries of the following steps are relative to this export.
+extern "C" unsigned char* export_cells() {
+    dirty_cells_tracking = true;
+    int i = 0;
+    for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+            for (int z = 0; z < depth; z++) {
+                render_cells[i++] = (unsigned char)render_cell_code(x, y, z);
+            }
+        }
+    }
+    return render_cells;
+}
+
+// Instance buffers of the renderer, filled by export_instances for the cells of
+// the selected types. JS draws them as InstancedBufferAttributes over this memory.
+// Region 0 holds the cells that change during a simulation and maps the cells
+// back to their instances, region 1 the walls and the door, which only change
+// with the layout (see get_layout_version). Shared by all the engine contexts,
+// the last export wins. Capped, so native builds with a large GRID_MAX_SIZE keep
+// their static data small; larger grids are not exported.
+constexpr int INSTANCE_CAPACITY = MAX_SIZE * MAX_SIZE * MAX_SIZE < (1 << 16) ? MAX_SIZE * MAX_SIZE * MAX_SIZE : (1 << 16);
+constexpr int INSTANCE_REGIONS = 2;
+constexpr int CELL_CODES = 8;
+// cell_instances entry of a wall or door cell, they are never patched
+constexpr int STATIC_CELL_INSTANCE = -2;
+
+struct InstanceRegion {
+    float matrices[INSTANCE_CAPACITY * 16]; // Column major, the identity with a translation
+    float colors[INSTANCE_CAPACITY * 3];
+    float opacities[INSTANCE_CAPACITY];
+    int cells[INSTANCE_CAPACITY];           // Cell index of every instance, as in render_cells
+};
+
+InstanceRegion instance_regions[INSTANCE_REGIONS];
+int cell_instances[INSTANCE_CAPACITY]; // Region 0 instance of every cell, -1 if not drawn
+float instance_colors[CELL_CODES * 3] = {};
+float instance_opacities[CELL_CODES] = {};
+
+// Counts the changes of the walls and the door (see layout_version), the renderer
+// exports region 1 again when it changed
+extern "C" int get_layout_version() {
+    return layout_version;
+}
+
+// Color and opacity of the instances of a render code
+extern "C" void set_instance_style(int code, float r, float g, float b, float opacity) {
+    if (code < 0 || code >= CELL_CODES) return;
+    instance_colors[code * 3] = r;
+    instance_colors[code * 3 + 1] = g;
+    instance_colors[code * 3 + 2] = b;
+    instance_opacities[code] = opacity;
+}
+
+// Writes an instance for every cell whose render code has its bit set in `codes`,
+// placed like the renderer places the cells: centered on x and z, on y = 0.
+// Region 0 also exports render_cells (see export_cells), so the dirty cells of
+// the following steps patch these instances. Returns the instance count, -1 if
+// the grid has more cells than the buffers.
+extern "C" int export_instances(int region, unsigned codes) {
+    if (region < 0 || region >= INSTANCE_REGIONS) return 0;
+    if (height * width * depth > INSTANCE_CAPACITY) return -1;
+    InstanceRegion& out = instance_regions[region];
+    if (region == 0) export_cells();
+    float offset_x = (height - 1) * 0.5f;
+    float offset_z = (depth - 1) * 0.5f;
+    int count = 0;
+    int cell = 0;
+    for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+            for (int z = 0; z < depth; z++, cell++) {
+                int code = region == 0 ? render_cells[cell] : render_cell_code(x, y, z);
+                bool is_static = code == 1 || code == 4;
+                if (region == 0) cell_instances[cell] = is_static ? STATIC_CELL_INSTANCE : -1;
+                if (is_static != (region == 1) || !(codes & (1u << code))) continue;
+
+                float* matrix = out.matrices + count * 16;
+                for (int i = 0; i < 16; i++) matrix[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+                matrix[12] = x - offset_x;
+                matrix[13] = y + 0.5f;
+                matrix[14] = z - offset_z;
+                out.colors[count * 3] = instance_colors[code * 3];
+                out.colors[count * 3 + 1] = instance_colors[code * 3 + 1];
+                out.colors[count * 3 + 2] = instance_colors[code * 3 + 2];
+                out.opacities[count] = instance_opacities[code];
+                out.cells[count] = cell;
+                if (region == 0) cell_instances[cell] = count;
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+extern "C" int get_instance_capacity() {
+    return INSTANCE_CAPACITY;
+}
+
+extern "C" float* get_instance_matrices(int region) {
+    return instance_regions[region].matrices;
+}
+
+extern "C" float* get_instance_colors(int region) {
+    return instance_regions[region].colors;
+}
+
+extern "C" float* get_instance_opacities(int region) {
+    return instance_regions[region].opacities;
+}
+
+extern "C" int* get_instance_cells(int region) {
+    return instance_regions[region].cells;
+}
+
+extern "C" int* get_cell_instances() {
+    return cell_instances;
+}
+
 // Initialize the grid with dimensions
 extern "C" void init_grid(int x, int y, int z) {
+    dirty_cells_invalidate();
+    layout_version++;
     height = min_int(MAX_SIZE, x);
     width = min_int(MAX_SIZE, y);
     depth = min_int(MAX_SIZE, z);
+    grid_layout.configure(height, width, depth);
     
-    memset(map, 0, sizeof(map));
-    memset(distances, 0, sizeof(distances));
-    memset(robot_field, 0, sizeof(robot_field));
+    map.clear();
+    distances.clear();
+    robot_field.clear();
     
     robot_count = 0;
     
@@ -717,8 +1007,8 @@ extern "C" void init_grid(int x, int y, int z) {
     simulation_complete = false;
     
     // Reset per-robot tracking arrays
-    memset(robot_steps, 0, sizeof(robot_steps));
-    memset(robot_time, 0, sizeof(robot_time));
+    memset(robot_steps, 0, sizeof(engine_storage.robot_steps));
+    memset(robot_time, 0, sizeof(engine_storage.robot_time));
     
     initialize_robot_states();
     // start_pos = Vector3Int(0, 0, 0);
@@ -726,21 +1016,23 @@ extern "C" void init_grid(int x, int y, int z) {
 
 // Set cell in the map
 extern "C" void set_cell(int x, int y, int z, int value) {
+    dirty_cells_invalidate();
+    layout_version++;
     if (x >= 0 && x < height && y >= 0 && y < width && z >= 0 && z < depth) {
         // Determine walkability based on type
         bool is_walkable = (value == 0 || value == 2 || value == 3 || value == 4);
         
         // Track changes in available cells
-        if (is_walkable && !map[x][y][z]) {
+        if (is_walkable && !map(x, y, z)) {
             available_cells++; // Increment if cell becomes walkable
-        } else if (!is_walkable && map[x][y][z]) {
+        } else if (!is_walkable && map(x, y, z)) {
             available_cells--; // Decrement if cell becomes unwalkable
         }
         
-        map[x][y][z] = is_walkable;
+        map(x, y, z) = is_walkable;
 
         // Handle robot state based on the new cell type
-        Robot* existing_robot = robot_field[x][y][z];
+        Robot* existing_robot = robot_field(x, y, z);
 
         if (value == 1) { // Placing a WALL
             // If there was a robot, just make it inactive (settled) instead of removing it
@@ -755,7 +1047,7 @@ extern "C" void set_cell(int x, int y, int z, int value) {
                 robots[robot_count] = Robot(Vector3Int(x, y, z));
                 robots[robot_count].id = robot_count;
                 robots[robot_count].active = (value == 2); // Active only if type is ROBOT
-                robot_field[x][y][z] = &robots[robot_count];
+                robot_field(x, y, z) = &robots[robot_count];
                 //console_log(1000 + robot_count); // Log: Robot added by set_cell
                 robot_count++;
             } else if (existing_robot) {
@@ -779,6 +1071,7 @@ extern "C" void add_robot(int x, int y, int z) {
         return;
     }
 
+    dirty_cells_invalidate();
     robots[robot_count] = Robot(Vector3Int(x, y, z));
     //console_log(1000 + robot_count); // Log: Robot added
     robot_count++;
@@ -794,8 +1087,485 @@ extern "C" void set_active_probability(int p) {
     g_active_probability = p;
 }
 
+// Expose setter to JS, dir is one of the codes of direction.h
+extern "C" void set_external_direction(int dir) {
+    if (dir < 0 || dir >= DIR_COUNT) return;
+    g_external_direction = (Dir)dir;
+}
+
+// Heap blocks: the storage of the created engine contexts and the trajectory buffer
+
+#if defined(__EMSCRIPTEN__) || defined(NO_STD_LIB)
+// Provided by wasm-ld, the first byte after the static data
+extern "C" unsigned char __heap_base;
+
+// The context storage is bump allocated from __heap_base, the trajectory buffer
+// follows it and grows in place by growing the memory
+unsigned char* heap_top = &__heap_base;
+bool trajectory_reserved = false;
+
+static bool heap_ensure(unsigned long end) {
+    unsigned long available = __builtin_wasm_memory_size(0) * 65536ul;
+    return end <= available || __builtin_wasm_memory_grow(0, (end - available + 65535) / 65536) >= 0;
+}
+
+unsigned char* trajectory_reserve(unsigned long bytes) {
+    if (!heap_ensure((unsigned long)heap_top + bytes)) return nullptr;
+    trajectory_reserved = true;
+    return heap_top;
+}
+
+// Nothing but the trajectory buffer writes the heap, so the new storage is zeroed
+EngineStorage* engine_storage_allocate() {
+    // The trajectory buffer would have to move
+    if (trajectory_reserved) return nullptr;
+    unsigned long start = ((unsigned long)heap_top + 15) & ~15ul;
+    if (!heap_ensure(start + sizeof(EngineStorage))) return nullptr;
+    heap_top = (unsigned char*)(start + sizeof(EngineStorage));
+    return (EngineStorage*)start;
+}
+#else
+unsigned char* trajectory_reserve(unsigned long bytes) {
+    static unsigned char* block = nullptr;
+    unsigned char* grown = (unsigned char*)std::realloc(block, bytes);
+    if (grown) block = grown;
+    return grown;
+}
+
+EngineStorage* engine_storage_allocate() {
+    return (EngineStorage*)std::calloc(1, sizeof(EngineStorage));
+}
+#endif
+
+// Engine contexts, independent simulations in one module and one memory. The
+// globals hold the selected context, the others keep their scalar state here
+// and their arrays in their own EngineStorage. Selecting one swaps the scalars
+// and points the array globals at its storage, so it costs the same for any
+// grid size. The scratch buffers (BFS queue, robot state buffer) are shared,
+// they are only used within one call. There is one trajectory, recorded or
+// replayed by the context that started or opened it (trajectory_context).
+constexpr int MAX_ENGINE_CONTEXTS = 64;
+
+// The defaults match the initial values of the globals
+struct EngineContext {
+    EngineStorage* storage;
+    int available_cells = 0;
+    int makespan = 0;
+    int t_max = 0;
+    int t_total = 0;
+    int e_max = 0;
+    int e_total = 0;
+    int simulation_steps = 0;
+    bool simulation_complete = false;
+    int width = 3;
+    int height = 4;
+    int depth = 4;
+    GridLayout grid_layout;
+    CellStateField cell_states{nullptr};
+    int robot_count = 0;
+    Vector3Int start_pos;
+    int last_loaded_map_index = 0;
+    int dirty_cell_head = 0;
+    bool dirty_cells_tracking = false;
+    int layout_version = 0;
+    int active_probability = 50;
+    Dir external_direction = DIR_UP;
+};
+
+// The saved state of the selected context is stale, its state is in the globals
+EngineContext engine_contexts[MAX_ENGINE_CONTEXTS] = {{&engine_storage}};
+int engine_context_count = 1;
+int engine_context_selected = 0;
+
+template<typename T>
+static inline void swap_value(T& a, T& b) {
+    T tmp = a;
+    a = b;
+    b = tmp;
+}
+
+// Swaps the scalar state of the globals with the saved one of a context
+static void engine_context_exchange(EngineContext& context) {
+    swap_value(available_cells, context.available_cells);
+    swap_value(makespan, context.makespan);
+    swap_value(t_max, context.t_max);
+    swap_value(t_total, context.t_total);
+    swap_value(e_max, context.e_max);
+    swap_value(e_total, context.e_total);
+    swap_value(simulation_steps, context.simulation_steps);
+    swap_value(simulation_complete, context.simulation_complete);
+    swap_value(width, context.width);
+    swap_value(height, context.height);
+    swap_value(depth, context.depth);
+    swap_value(grid_layout, context.grid_layout);
+    swap_value(cell_states, context.cell_states);
+    swap_value(robot_count, context.robot_count);
+    swap_value(start_pos, context.start_pos);
+    swap_value(last_loaded_map_index, context.last_loaded_map_index);
+    swap_value(dirty_cell_head, context.dirty_cell_head);
+    swap_value(dirty_cells_tracking, context.dirty_cells_tracking);
+    swap_value(layout_version, context.layout_version);
+    swap_value(g_active_probability, context.active_probability);
+    swap_value(g_external_direction, context.external_direction);
+}
+
+static void engine_bind_storage(EngineStorage* storage) {
+    robots = storage->robots;
+    prev_robot_states = storage->prev_robot_states;
+    curr_robot_states = storage->curr_robot_states;
+    robot_steps = storage->robot_steps;
+    robot_time = storage->robot_time;
+    map.cells = storage->map;
+    distances.cells = storage->distances;
+    robot_field.cells = storage->robot_field;
+    cell_states.cells = storage->cell_states;
+    render_cells = storage->render_cells;
+    dirty_cells = storage->dirty_cells;
+}
+
+// Creates a context with the default empty grid, the selection does not change.
+// Returns its id, or -1 if there is no room for it. In the browser no context
+// can be created once a trajectory buffer was reserved.
+extern "C" int create_context() {
+    if (engine_context_count >= MAX_ENGINE_CONTEXTS) return -1;
+    EngineStorage* storage = engine_storage_allocate();
+    if (!storage) return -1;
+    engine_contexts[engine_context_count] = EngineContext{storage};
+    return engine_context_count++;
+}
+
+// Makes the engine exports act on a context, false for an unknown id
+extern "C" bool select_context(int id) {
+    if (id < 0 || id >= engine_context_count) return false;
+    if (id == engine_context_selected) return true;
+    engine_context_exchange(engine_contexts[engine_context_selected]);
+    engine_context_exchange(engine_contexts[id]);
+    engine_bind_storage(engine_contexts[id].storage);
+    engine_context_selected = id;
+    return true;
+}
+
+extern "C" int get_context_count() {
+    return engine_context_count;
+}
+
+// Trajectory recording and replay (format in trajectory.h)
+
+TrajectoryWriter trajectory;
+bool trajectory_recording = false;
+int trajectory_context = 0; // Context that records or replays the trajectory, the others leave it alone
+int trajectory_steps = 0; // Recorded steps, or the steps of the opened trajectory
+unsigned trajectory_keyframes[TRAJECTORY_MAX_KEYFRAMES]; // Offsets, only while recording
+int trajectory_keyframe_count = 0;
+
+// Robot state at the end of the last recorded step, a robot moved if its step count changed
+int trajectory_prev_count = 0;
+bool trajectory_prev_active[MAX_ROBOTS];
+int trajectory_prev_steps[MAX_ROBOTS];
+
+void trajectory_save_prev() {
+    trajectory_prev_count = robot_count;
+    for (int i = 0; i < robot_count; i++) {
+        trajectory_prev_active[i] = robots[i].active;
+        trajectory_prev_steps[i] = robot_steps[i];
+    }
+}
+
+void trajectory_write_keyframe() {
+    if (trajectory_keyframe_count >= TRAJECTORY_MAX_KEYFRAMES) return;
+    trajectory_keyframes[trajectory_keyframe_count++] = (unsigned)trajectory.size;
+
+    // The length lets a sequential reader skip the keyframe, it is at most 5 + 16 bytes per robot
+    unsigned long length_at = trajectory.size;
+    trajectory.u32(0);
+    unsigned long start = trajectory.size;
+    trajectory.varint(robot_count);
+    for (int i = 0; i < robot_count; i++) {
+        const Robot& robot = robots[i];
+        trajectory.varint(robot.position.x);
+        trajectory.varint(robot.position.y);
+        trajectory.varint(robot.position.z);
+        trajectory.byte((robot.active ? TRAJECTORY_FLAG_ACTIVE : 0) | (robot.sleeping ? TRAJECTORY_FLAG_SLEEPING : 0) |
+                        (robot.last_move << TRAJECTORY_FLAG_MOVE_SHIFT));
+    }
+    if (!trajectory.overflow) trajectory.patch_u32(length_at, (unsigned)(trajectory.size - start));
+}
+
+// Starts recording the steps from the current state, normally right after load_map
+extern "C" int trajectory_start() {
+    trajectory_context = engine_context_selected;
+    trajectory.reset();
+    trajectory_steps = 0;
+    trajectory_keyframe_count = 0;
+
+    trajectory.byte('U');
+    trajectory.byte('D');
+    trajectory.byte('P');
+    trajectory.byte('T');
+    trajectory.byte(TRAJECTORY_VERSION);
+    trajectory.varint(height);
+    trajectory.varint(width);
+    trajectory.varint(depth);
+    trajectory.varint(start_pos.x);
+    trajectory.varint(start_pos.y);
+    trajectory.varint(start_pos.z);
+    trajectory.varint(TRAJECTORY_KEYFRAME_INTERVAL);
+    for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+            for (int z = 0; z < depth; z++) {
+                trajectory.bits(map(x, y, z) ? 1 : 0, 1);
+            }
+        }
+    }
+    trajectory.flush_bits();
+
+    trajectory_write_keyframe();
+    trajectory_save_prev();
+
+    trajectory_recording = !trajectory.overflow;
+    return trajectory_recording ? 1 : 0;
+}
+
+// Called at the end of simulate_step while recording
+void trajectory_record_step() {
+    // Move codes of the robots that were active when the step started
+    for (int i = 0; i < trajectory_prev_count; i++) {
+        if (!trajectory_prev_active[i]) continue;
+        const Robot& robot = robots[i];
+        if (robot_steps[i] != trajectory_prev_steps[i]) {
+            trajectory.bits(robot.last_move, 3);
+        } else {
+            trajectory.bits(robot.sleeping ? TRAJECTORY_MOVE_SLEPT : TRAJECTORY_MOVE_STAYED, 3);
+        }
+    }
+    trajectory.flush_bits();
+
+    int settled = 0;
+    for (int i = 0; i < trajectory_prev_count; i++) {
+        if (trajectory_prev_active[i] && !robots[i].active) settled++;
+    }
+    trajectory.varint(settled);
+    int last = -1;
+    for (int i = 0; i < trajectory_prev_count; i++) {
+        if (trajectory_prev_active[i] && !robots[i].active) {
+            trajectory.varint(i - last - 1);
+            last = i;
+        }
+    }
+    trajectory.varint(robot_count - trajectory_prev_count);
+
+    trajectory_save_prev();
+    trajectory_steps++;
+    if (trajectory_steps % TRAJECTORY_KEYFRAME_INTERVAL == 0) {
+        trajectory_write_keyframe();
+    }
+    if (trajectory.overflow) trajectory_recording = false;
+}
+
+// Ends the recording with the keyframe index, returns the size of the trajectory
+// in get_trajectory_buffer or 0 if nothing complete was recorded
+extern "C" int trajectory_finish() {
+    if (!trajectory_recording) return 0;
+    trajectory_recording = false;
+
+    unsigned long footer = trajectory.size;
+    trajectory.u32(trajectory_keyframe_count);
+    trajectory.u32(TRAJECTORY_KEYFRAME_INTERVAL);
+    trajectory.u32(trajectory_steps);
+    for (int i = 0; i < trajectory_keyframe_count; i++) trajectory.u32(trajectory_keyframes[i]);
+    trajectory.u32((unsigned)footer);
+    trajectory.byte('U');
+    trajectory.byte('D');
+    trajectory.byte('P');
+    trajectory.byte('E');
+    return trajectory.overflow ? 0 : (int)trajectory.size;
+}
+
+extern "C" unsigned char* get_trajectory_buffer() {
+    return trajectory.data;
+}
+
+// Makes room for a trajectory of `size` bytes that JS copies into get_trajectory_buffer
+extern "C" unsigned char* trajectory_reserve_buffer(int size) {
+    trajectory_recording = false;
+    trajectory.reset();
+    return trajectory.ensure(size) ? trajectory.data : nullptr;
+}
+
+// Replay of an opened trajectory
+TrajectoryCursor trajectory_replay;
+int trajectory_replay_step = -1; // Step of the robots in the engine, -1 if not positioned yet
+int trajectory_interval = TRAJECTORY_KEYFRAME_INTERVAL;
+int trajectory_replay_keyframes = 0;
+unsigned long trajectory_keyframe_table = 0; // Offset of the keyframe offsets in the footer
+
+void trajectory_read_keyframe(int keyframe) {
+    TrajectoryCursor& in = trajectory_replay;
+    in.seek(in.u32_at(trajectory_keyframe_table + 4ul * keyframe) + 4);
+    int count = in.varint();
+    if (count > MAX_ROBOTS) {
+        in.error = true;
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        int x = in.varint();
+        int y = in.varint();
+        int z = in.varint();
+        unsigned flags = in.byte();
+        robots[i] = Robot(Vector3Int(x, y, z));
+        robots[i].id = i;
+        robots[i].active = (flags & TRAJECTORY_FLAG_ACTIVE) != 0;
+        robots[i].sleeping = (flags & TRAJECTORY_FLAG_SLEEPING) != 0;
+        robots[i].last_move = (Dir)((flags >> TRAJECTORY_FLAG_MOVE_SHIFT) & 7);
+        robots[i].settled_for = robots[i].active ? 0 : 6;
+    }
+    robot_count = count;
+    trajectory_replay_step = keyframe * trajectory_interval;
+}
+
+// Applies the record of the next step to the robots
+void trajectory_read_step() {
+    TrajectoryCursor& in = trajectory_replay;
+    for (int i = 0; i < robot_count; i++) {
+        Robot& robot = robots[i];
+        if (!robot.active) continue;
+        unsigned code = in.bits(3);
+        if (code < DIR_COUNT) {
+            robot.position = robot.position + dirOffset((Dir)code);
+            robot.target = robot.position;
+            robot.last_move = (Dir)code;
+            robot.sleeping = false;
+        } else {
+            robot.sleeping = code == TRAJECTORY_MOVE_SLEPT;
+        }
+    }
+    in.align();
+
+    int settled = in.varint();
+    int index = -1;
+    for (int i = 0; i < settled; i++) {
+        index += in.varint() + 1;
+        if (index >= robot_count) {
+            in.error = true;
+            return;
+        }
+        robots[index].active = false;
+    }
+    for (int i = 0; i < robot_count; i++) {
+        if (!robots[i].active) robots[i].settled_for++;
+    }
+
+    int spawned = in.varint();
+    for (int i = 0; i < spawned && robot_count < MAX_ROBOTS; i++) {
+        robots[robot_count] = Robot(start_pos);
+        robots[robot_count].id = robot_count;
+        robot_count++;
+    }
+
+    trajectory_replay_step++;
+    // Skip the keyframe of the new step, its state is what was just decoded
+    if (trajectory_replay_step % trajectory_interval == 0 &&
+        trajectory_replay_step / trajectory_interval < trajectory_replay_keyframes) {
+        unsigned long length = in.u32_at(in.pos);
+        in.seek(in.pos + 4 + length);
+    }
+}
+
+// Shows a step of the opened trajectory: the robots and the robot field are set as
+// they were after that many steps. Moving forward continues from the current step,
+// other seeks start from the closest keyframe. Returns 1 on success.
+extern "C" int trajectory_seek(int step) {
+    if (engine_context_selected != trajectory_context) return 0;
+    if (trajectory_replay_step < 0 || step < 0 || step > trajectory_steps) return 0;
+
+    int keyframe = step / trajectory_interval;
+    if (keyframe >= trajectory_replay_keyframes) keyframe = trajectory_replay_keyframes - 1;
+    if (step < trajectory_replay_step || keyframe * trajectory_interval > trajectory_replay_step) {
+        trajectory_read_keyframe(keyframe);
+    }
+    while (trajectory_replay_step < step && !trajectory_replay.error) {
+        trajectory_read_step();
+    }
+    if (trajectory_replay.error) {
+        trajectory_replay_step = -1;
+        return 0;
+    }
+
+    generateRobotField();
+    initialize_robot_states();
+    dirty_cells_invalidate();
+    simulation_steps = step;
+    makespan = step;
+    simulation_complete = step == trajectory_steps;
+    return 1;
+}
+
+// Opens the trajectory of `size` bytes in get_trajectory_buffer: loads its map and
+// shows step 0. Returns the number of steps or -1 if the data is not a trajectory.
+extern "C" int trajectory_open(int size) {
+    trajectory_context = engine_context_selected;
+    trajectory_recording = false;
+    trajectory_replay_step = -1;
+    TrajectoryCursor& in = trajectory_replay;
+    in.data = trajectory.data;
+    in.size = size;
+    in.seek(0);
+
+    if (size < 13 || in.byte() != 'U' || in.byte() != 'D' || in.byte() != 'P' || in.byte() != 'T' ||
+        in.byte() != TRAJECTORY_VERSION) {
+        return -1;
+    }
+    const unsigned char* end = trajectory.data + size - 4;
+    if (end[0] != 'U' || end[1] != 'D' || end[2] != 'P' || end[3] != 'E') return -1;
+    unsigned long footer = in.u32_at(size - 8);
+    trajectory_replay_keyframes = in.u32_at(footer);
+    trajectory_interval = in.u32_at(footer + 4);
+    trajectory_steps = in.u32_at(footer + 8);
+    trajectory_keyframe_table = footer + 12;
+    if (in.error || trajectory_replay_keyframes < 1 || trajectory_interval < 1 ||
+        trajectory_keyframe_table + 4ul * trajectory_replay_keyframes + 8 > (unsigned long)size) {
+        return -1;
+    }
+
+    int size_x = in.varint();
+    int size_y = in.varint();
+    int size_z = in.varint();
+    Vector3Int start;
+    start.x = in.varint();
+    start.y = in.varint();
+    start.z = in.varint();
+    in.varint(); // Keyframe interval, the footer has it too
+    if (in.error || size_x > MAX_SIZE || size_y > MAX_SIZE || size_z > MAX_SIZE) return -1;
+
+    init_grid(size_x, size_y, size_z);
+    for (int x = 0; x < height; x++) {
+        for (int y = 0; y < width; y++) {
+            for (int z = 0; z < depth; z++) {
+                map(x, y, z) = in.bits(1) != 0;
+            }
+        }
+    }
+    start_pos = start;
+    bfs();
+    if (in.error) return -1;
+
+    trajectory_read_keyframe(0);
+    if (!trajectory_seek(0)) return -1;
+    return trajectory_steps;
+}
+
+extern "C" int get_trajectory_steps() {
+    return trajectory_steps;
+}
+
 // Simulate one step of the algorithm
 extern "C" void simulate_step() {
+    PROFILE_STEP_BEGIN();
+
+    if (dirty_cells_tracking) {
+        dirty_cells_begin_step();
+    }
+
     // Increment simulation step counter
     simulation_steps++;
 
@@ -804,10 +1574,10 @@ extern "C" void simulate_step() {
     
     // Check if there's a robot at the start position and log it
     int robot_index = -1;
-    if (robot_field[start_pos.x][start_pos.y][start_pos.z] != nullptr) {
+    if (robot_field(start_pos.x, start_pos.y, start_pos.z) != nullptr) {
         // Find which robot is at the start position
         for (int i = 0; i < robot_count; i++) {
-            if (&robots[i] == robot_field[start_pos.x][start_pos.y][start_pos.z]) {
+            if (&robots[i] == robot_field(start_pos.x, start_pos.y, start_pos.z)) {
                 robot_index = i;
                 break;
             }
@@ -828,38 +1598,54 @@ extern "C" void simulate_step() {
     
     // Reset the simulation completion flag
     simulation_complete = true;
+
+    {
+        PROFILE_SCOPE(PHASE_CELL_STATES);
+        refresh_cell_states();
+    }
     
     // Calculate neighbors for each robot and update their state
-    for (int i = 0; i < robot_count; i++) {
-        Robot& robot = robots[i];
+    {
+        PROFILE_SCOPE(PHASE_ROBOTS);
+        for (int i = 0; i < robot_count; i++) {
+            Robot& robot = robots[i];
 
-        // If any robot is active, the simulation is not complete
-        if (robot.active) {
-            simulation_complete = false;
-            
-            // Generate primary neighbor data for the robot's current position
-            array<CellState, 3*3*3> neighbours;
-            generateNeighbors(robot.position.x, robot.position.y, robot.position.z, neighbours);
+            // If any robot is active, the simulation is not complete
+            if (robot.active) {
+                simulation_complete = false;
             
-            // Generate second neighbor data (same as primary but will be modified)
-            array<CellState, 3*3*3> neighbours2;
-            generateNeighbors(robot.position.x, robot.position.y, robot.position.z, neighbours2);
-
-            if(randomInt(0,100) <= g_active_probability) {
-                // Call lookCompute with the distance from start position
-                robot.sleeping = false;
-                robot.lookCompute(neighbours, neighbours2, distances[robot.position.x][robot.position.y][robot.position.z]);
-            } else {
-                robot.sleeping = true;
+                // Generate neighbor data for the robot's current position
+                Neighborhood neighbours;
+                {
+                    PROFILE_SAMPLE(PHASE_NEIGHBORS);
+                    neighbours = gatherNeighborhood(robot.position.x, robot.position.y, robot.position.z);
+                }
+
+                // At p = 100 every robot is active, no need to draw a random number
+                if(g_active_probability >= 100 || randomInt(0,100) <= g_active_probability) {
+                    // Call lookCompute with the distance from start position
+                    robot.sleeping = false;
+                    {
+                        PROFILE_SAMPLE(PHASE_LOOK_COMPUTE);
+                        robot.lookCompute(neighbours, distances(robot.position.x, robot.position.y, robot.position.z));
+                    }
+
+                    // A settled robot is a wall for the robots after it in this step
+                    if (!robot.active) {
+                        refresh_cell_state(robot.position.x, robot.position.y, robot.position.z);
+                    }
+                } else {
+                    robot.sleeping = true;
+                }
             }
         }
     }
 
 
-    if (robot_field[start_pos.x][start_pos.y][start_pos.z] == nullptr) {
+    if (robot_field(start_pos.x, start_pos.y, start_pos.z) == nullptr) {
         robots[robot_count] = Robot(start_pos);
         // Make sure the robot state tracking system knows this robot is active
-        // robot_field[start_pos.x][start_pos.y][start_pos.z] = &robots[robot_count];
+        // robot_field(start_pos.x, start_pos.y, start_pos.z) = &robots[robot_count];
         //console_log(1000 + robot_count); // Log: Robot added by set_cell
         robot_count++;
         
@@ -869,54 +1655,61 @@ extern "C" void simulate_step() {
 
     
 
-    for (int i = 0; i < robot_count; i++) {
-        Robot& robot = robots[i];
-        if (robot.active) {
-            // Check if position will actually change (to count steps)
-            bool moving = robot.position != robot.target;
+    {
+        PROFILE_SCOPE(PHASE_MOVE);
+        for (int i = 0; i < robot_count; i++) {
+            Robot& robot = robots[i];
+            if (robot.active) {
+                // Check if position will actually change (to count steps)
+                bool moving = robot.position != robot.target;
             
-            // Move the robot
-            robot.move();
+                // Move the robot
+                robot.move();
             
-            // Update tracking metrics
-            robot_time[i]++;  // Increment time spent for active robots
+                // Update tracking metrics
+                robot_time[i]++;  // Increment time spent for active robots
             
-            // Only count as a step if the robot actually moved
-            if (moving) {
-                robot_steps[i]++;  // Count steps for this robot
-                t_total++;         // Increment total steps counter
-            }
+                // Only count as a step if the robot actually moved
+                if (moving) {
+                    PROFILE_COUNT(COUNTER_MOVES, 1);
+                    robot_steps[i]++;  // Count steps for this robot
+                    t_total++;         // Increment total steps counter
+                }
             
-            // Update t_max if this robot has taken more steps
-            if (robot_steps[i] > t_max) {
-                t_max = robot_steps[i];
+                // Update t_max if this robot has taken more steps
+                if (robot_steps[i] > t_max) {
+                    t_max = robot_steps[i];
+                }
+            } else {
+                robot.settled_for++;
             }
-        } else {
-            robot.settled_for++;
-        }
         
-        // Update e_total and e_max
-        // robot_time[i]++;  // Increment time spent (active or not)
-        e_total++;        // Increment total time counter
+            // Update e_total and e_max
+            // robot_time[i]++;  // Increment time spent (active or not)
+            e_total++;        // Increment total time counter
         
-        // Update e_max if this robot has spent more time
-        if (robot_time[i] > e_max) {
-            e_max = robot_time[i];
+            // Update e_max if this robot has spent more time
+            if (robot_time[i] > e_max) {
+                e_max = robot_time[i];
+            }
         }
     }
 
     // Update robot field
-    generateRobotField();
+    {
+        PROFILE_SCOPE(PHASE_ROBOT_FIELD);
+        generateRobotField();
+    }
 
     for (int x = 0; x < height; x++) {
         for (int y = 0; y < width; y++) {
             for (int z = 0; z < depth; z++) {
-                if (!map[x][y][z]) continue;
+                if (!map(x, y, z)) continue;
                
-                if (robot_field[x][y][z] == nullptr) {
+                if (robot_field(x, y, z) == nullptr) {
                     // Noop
                 } else {
-                    if (robot_field[x][y][z]->active) {
+                    if (robot_field(x, y, z)->active) {
                         // Active robot - do nothing
                     } else {
                        // Pass
@@ -929,9 +1722,34 @@ extern "C" void simulate_step() {
 
     makespan = simulation_steps;
 
+    if (dirty_cells_tracking) {
+        dirty_cells_end_step();
+    }
+
+    if (trajectory_recording && engine_context_selected == trajectory_context) {
+        trajectory_record_step();
+    }
+
+    PROFILE_STEP_END();
+
     //console_log(5002); // Log: simulate_step end
 }
 
+// Passed to simulate_steps to run until every robot settled
+constexpr int SIMULATE_UNTIL_COMPLETE = 0x7fffffff;
+
+// Runs up to `count` steps and stops early once the simulation is complete, so a
+// frame that is several steps behind (or a whole headless run) is a single call.
+// Returns the number of steps that were run.
+extern "C" int simulate_steps(int count) {
+    int executed = 0;
+    while (executed < count && !simulation_complete) {
+        simulate_step();
+        executed++;
+    }
+    return executed;
+}
+
 // // Create a demo grid for testing
 // extern "C" void create_demo_grid() {
 //     // Reset simulation metrics
@@ -1029,56 +1847,59 @@ extern "C" int get_robot_count() {
     return robot_count;
 }
 
+// Step profiler (see profiler.h), all values are 0 unless built with ENABLE_PROFILER
+extern "C" int is_profiler_enabled() {
+#ifdef ENABLE_PROFILER
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+extern "C" void reset_profiler() {
+    g_profiler.reset();
+}
+
+extern "C" int get_profile_steps() {
+    return g_profiler.steps;
+}
+
+// Time of a phase in the last step, in nanoseconds
+extern "C" double get_profile_phase_ns(int phase) {
+    if (phase < 0 || phase >= PHASE_COUNT) return 0;
+    return g_profiler.phase_ns[phase];
+}
+
+// Time of a phase summed over all steps since the last reset, in nanoseconds
+extern "C" double get_profile_total_phase_ns(int phase) {
+    if (phase < 0 || phase >= PHASE_COUNT) return 0;
+    return g_profiler.total_phase_ns[phase];
+}
+
+// Counter value in the last step
+extern "C" int get_profile_counter(int counter) {
+    if (counter < 0 || counter >= COUNTER_COUNT) return 0;
+    return g_profiler.counters[counter];
+}
+
+// Counter summed over all steps since the last reset
+extern "C" double get_profile_total_counter(int counter) {
+    if (counter < 0 || counter >= COUNTER_COUNT) return 0;
+    return g_profiler.total_counters[counter];
+}
+
 // Get cell state for rendering
 extern "C" int get_cell(int x, int y, int z) {
-    // 1. Check bounds
     if (x < 0 || x >= height || y < 0 || y >= width || z < 0 || z >= depth) {
         return 0; // Out of bounds is Empty
     }
-    
-    // 2. Check if it's the start/door position
-    if (x == start_pos.x && y == start_pos.y && z == start_pos.z) {
-        // Important: Door position is special - always render as DOOR (4), even if a robot is here
-        // This ensures the door is always visible and robots can still spawn here
-        return 4; // Always render Door at start position
-    }
-    
-    // 3. Check for robots
-    if (robot_field[x][y][z] != nullptr) {
-        if (robot_field[x][y][z]->active) {
-            if(robot_field[x][y][z]->sleeping) {
-                return 5; // Sleeping
-            } else {
-                return 2; // Active robot
-            }
-        } else {
-            // Settled robot
-            if (robot_field[x][y][z]->settled_for <= 5) {
-                return 3; // Recently settled robot (visual distinction)
-            } else {
-                // Only log transformation once when robot transitions from state 3 to state 1
-                if (robot_field[x][y][z]->settled_for == 6) {
-                    // This is the exact point of transition - log it once
-                    // // console_log(4000 + (robot_field[x][y][z] - robots)); // Log: Settled robot transforms into wall
-                }
-                return 3; // Older settled robot visually becomes a wall
-            }
-        }
-    }
-    
-    // 4. If no robot, check the map
-    if (map[x][y][z]) {
-        // Walkable space (but not door or robot) -> render as Empty floor/space
-        return 0; 
-    } else {
-        // Not walkable according to map -> render as Wall
-        return 1; 
-    }
+    return render_cell_code(x, y, z);
 }
 
 
 
 
+
 // This is a 3 bit type, the rest will be used for metadata
 enum class RobotDiff {
     NoChange = 0,
@@ -1095,170 +1916,80 @@ int box_type(Robot& robot, int robot_index, RobotDiff diff) {
         return -1; // Invalid index
     }
 
-    // we will put the direction of the movement as 3 bits
-
-    // find the direction in getAllDirections
-    auto all_directions = robot.getAllDirections();
-    int direction = -1;
-    for (int i = 0; i < 6; ++i) {
-        if (robot.last_move == all_directions[i]) {
-            direction = i;
-            break;
-        }
-    }
-
+    // we will put the direction of the movement as 3 bits, the codes of direction.h
     // direction = 0 <- up
     // direction = 1 <- forward
     // direction = 2 <- left
     // direction = 3 <- down
     // direction = 4 <- back
     // direction = 5 <- right
-    if (direction == -1) {
-        // Invalid direction
-        return 6; // No direction
-    }
+    // direction = 7 <- none, the robot has not moved yet
+    int direction = robot.last_move;
 
     return static_cast<int>(diff) | (direction << 3); 
 }
 
 
-extern "C" int pop_robot_state(int robot_index) {
-    if (robot_index < 0 || robot_index >= MAX_ROBOTS) {
-        return -1; // Invalid index
-    }
-
-    auto curr_state = curr_robot_states[robot_index];
-    auto prev_state = prev_robot_states[robot_index];
-
-    RobotDiff answer = RobotDiff::Invalid;
-    // define the state transitions
-
-    // IDLE -> ACTIVE = Moving
-    if (prev_state == RobotState::IDLE && curr_state == RobotState::ACTIVE) {
-        answer = RobotDiff::Moving;
-    }
-
-    // ACTIVE -> IDLE = Stopped
-    if (prev_state == RobotState::ACTIVE && curr_state == RobotState::IDLE) {
-        answer = RobotDiff::Stopped;
-    }
-
-    // ACTIVE -> SETTLED = Settled
-    if (prev_state == RobotState::ACTIVE && curr_state == RobotState::SETTLED) {
-        answer = RobotDiff::Settled;
-    }
-
-    // SETTLED -> IDLE = INVALID
-    if (prev_state == RobotState::SETTLED && curr_state == RobotState::IDLE) {
-        answer = RobotDiff::Invalid;
-    }
-
-    // IDLE -> SETTLED = INVALID
-    if (prev_state == RobotState::IDLE && curr_state == RobotState::SETTLED) {
-        answer = RobotDiff::Settled;
-    }
-
-    // SETTLED -> ACTIVE = INVALID
-    if (prev_state == RobotState::SETTLED && curr_state == RobotState::ACTIVE) {
-        answer = RobotDiff::Invalid;
-    }
-
-    // IDLE -> IDLE = No change
-    if (prev_state == RobotState::IDLE && curr_state == RobotState::IDLE) {
-        answer = RobotDiff::NoChange;
-    }
-
-    // ACTIVE -> ACTIVE = No change
-    if (prev_state == RobotState::ACTIVE && curr_state == RobotState::ACTIVE) {
-        answer = RobotDiff::Moving;
-    }
-
-    // SETTLED -> SETTLED = No change
-    if (prev_state == RobotState::SETTLED && curr_state == RobotState::SETTLED) {
-        answer = RobotDiff::NoChange;
-    }
-
-    // IDLE -> SLEEPING = Sleeping
-    if (prev_state == RobotState::IDLE && curr_state == RobotState::IDLE) {
-        answer = RobotDiff::Sleeping;
-    }
-
-    // SLEEPING -> IDLE = No change
-    if (prev_state == RobotState::IDLE && curr_state == RobotState::IDLE) {
-        answer = RobotDiff::NoChange;
-    }
-
-    // SLEEPING -> ACTIVE = Moving
-    if (prev_state == RobotState::IDLE && curr_state == RobotState::ACTIVE) {
-        answer = RobotDiff::Moving;
-    }
-
-    // SLEEPING -> SETTLED = Settled
-    if (prev_state == RobotState::IDLE && curr_state == RobotState::SETTLED) {
-        answer = RobotDiff::Settled;
-    }
+// Diff of a robot by [previous][current] state. These are the results of the
+// rules pop_robot_state used to apply one after the other, where a later rule
+// overrode an earlier one for the same pair: a robot that is not active is
+// reported as sleeping, ACTIVE -> IDLE included.
+constexpr RobotDiff ROBOT_DIFF_TABLE[3][3] = {
+    //  IDLE                ACTIVE              SETTLED
+    {RobotDiff::Sleeping, RobotDiff::Moving,  RobotDiff::Settled},  // IDLE
+    {RobotDiff::Sleeping, RobotDiff::Moving,  RobotDiff::Settled},  // ACTIVE
+    {RobotDiff::Invalid,  RobotDiff::Invalid, RobotDiff::NoChange}, // SETTLED
+};
 
-    // SLEEPING -> SLEEPING = No change
-    if (prev_state == RobotState::IDLE && curr_state == RobotState::IDLE) {
-        answer = RobotDiff::Sleeping;
-    }
+// Diff since the last pop, advances the states of the robot
+inline RobotDiff pop_robot_diff(int robot_index) {
+    RobotState curr_state = curr_robot_states[robot_index];
+    RobotDiff answer = ROBOT_DIFF_TABLE[(int)prev_robot_states[robot_index]][(int)curr_state];
 
-    // Active -> Sleeping = Sleeping
-    if (prev_state == RobotState::ACTIVE && curr_state == RobotState::IDLE) {
-        answer = RobotDiff::Sleeping;
-    }
-
-    // Update the previous state to the current state
     prev_robot_states[robot_index] = curr_state;
+    curr_robot_states[robot_index] = robots[robot_index].active ? RobotState::ACTIVE : RobotState::SETTLED;
+    return answer;
+}
 
-    // update the current state
-
-    if (robots[robot_index].active) {
-        curr_robot_states[robot_index] = RobotState::ACTIVE;
-    } else {
-        curr_robot_states[robot_index] = RobotState::SETTLED;
+extern "C" int pop_robot_state(int robot_index) {
+    if (robot_index < 0 || robot_index >= MAX_ROBOTS) {
+        return -1; // Invalid index
     }
-    
-
+    RobotDiff answer = pop_robot_diff(robot_index);
     return box_type(robots[robot_index], robot_index, answer);
 }
 
-// Load a predefined map from maps.h by index (loads first map by default)
-extern "C" void load_map(int map_index = 0) {
-    // Make sure our vectors are initialized
-    up = Vector3Int(0, 1, 0);
-    down = Vector3Int(0, -1, 0);
-    left = Vector3Int(-1, 0, 0);
-    right = Vector3Int(1, 0, 0);
-    forward = Vector3Int(0, 0, 1);
-    back = Vector3Int(0, 0, -1);
-    zero = Vector3Int(0, 0, 0);
+// Buffer for pop_all_robot_states owned by the module, so JS does not have to allocate in it
+unsigned char robot_state_buffer[MAX_ROBOTS];
 
-    // Validate map index
-    if (map_index < 0 || map_index >= WasmMaps::ALL_MAPS_COUNT) {
-        // console_log(8000 + map_index); // Log: Invalid map index
-        
-        // If an invalid index is provided but we have maps, load the first one
-        if (WasmMaps::ALL_MAPS_COUNT > 0) {
-            map_index = 0; // Default to the first map
-        } else {
-            return; // No maps available
-        }
+extern "C" unsigned char* get_robot_state_buffer() {
+    return robot_state_buffer;
+}
+
+// pop_robot_state of the robots 0 .. min(robot_count, max) - 1 in one call, one
+// byte each (diff in the low 3 bits, direction in the next 3). Returns the count.
+extern "C" int pop_all_robot_states(unsigned char* out, int max) {
+    int count = robot_count < max ? robot_count : max;
+    for (int i = 0; i < count; i++) {
+        out[i] = (unsigned char)box_type(robots[i], i, pop_robot_diff(i));
     }
+    return count;
+}
 
-    // Store the current map index for use in reset
-    last_loaded_map_index = map_index;
+// Load a map given in the packed bit format of maps.h, used for the baked in and for generated maps
+void load_map_info(const WasmMaps::MapInfo& map_info) {
+    // A recording only covers one run of its context
+    if (engine_context_selected == trajectory_context) trajectory_recording = false;
+
+    // Make sure our vectors are initialized, the directions are constexpr tables
+    zero = Vector3Int(0, 0, 0);
 
-    
-    // Get the map info
-    const WasmMaps::MapInfo& map_info = WasmMaps::all_maps[map_index];
-    
     // NOTE: The map dimensions from maps.h are in (x,y,z) order
     // The MapInfo struct stores them as size_x, size_y, size_z
     // But our map data in main.cpp uses [x][y][z] ordering
     
     // In the JSON, map is accessed as map[z][y][x]
-    // In our WebAssembly C++ code, map is accessed as map[x][y][z]
+    // In our WebAssembly C++ code, map is accessed as map(x, y, z)
     // We need to initialize the grid with the correct coordinate mapping
     
     // Initialize the grid with the map dimensions - swapping X and Z to match our internal representation
@@ -1282,7 +2013,7 @@ extern "C" void load_map(int map_index = 0) {
                 
                 // Set the cell based on the bit value
                 // Our map is indexed as [x][y][z] in our C++ code
-                map[x][y][z] = isWalkable; // map stores walkability (true = walkable)
+                map(x, y, z) = isWalkable; // map stores walkability (true = walkable)
                 
                 // Set the door at the start position - note we're now checking the correct coordinates
                 if (x == map_info.start.x && y == map_info.start.y && z == map_info.start.z) {
@@ -1311,14 +2042,34 @@ extern "C" void load_map(int map_index = 0) {
     simulation_complete = false;
     
     // Reset per-robot tracking arrays
-    memset(robot_steps, 0, sizeof(robot_steps));
-    memset(robot_time, 0, sizeof(robot_time));
+    memset(robot_steps, 0, sizeof(engine_storage.robot_steps));
+    memset(robot_time, 0, sizeof(engine_storage.robot_time));
     
     // Set the start position consistently
     set_start_position(map_info.start.x, map_info.start.y, map_info.start.z);
    
 }
 
+// Load a predefined map from maps.h by index (loads first map by default)
+extern "C" void load_map(int map_index = 0) {
+    // Validate map index
+    if (map_index < 0 || map_index >= WasmMaps::ALL_MAPS_COUNT) {
+        // console_log(8000 + map_index); // Log: Invalid map index
+        
+        // If an invalid index is provided but we have maps, load the first one
+        if (WasmMaps::ALL_MAPS_COUNT > 0) {
+            map_index = 0; // Default to the first map
+        } else {
+            return; // No maps available
+        }
+    }
+
+    // Store the current map index for use in reset
+    last_loaded_map_index = map_index;
+
+    load_map_info(WasmMaps::all_maps[map_index]);
+}
+
 // Function to get the number of available maps
 extern "C" int get_map_count() {
     return WasmMaps::ALL_MAPS_COUNT;
@@ -1380,15 +2131,15 @@ extern "C" void reset_simulation() {
     simulation_complete = false;
     
     // Reset per-robot tracking arrays
-    memset(robot_steps, 0, sizeof(robot_steps));
-    memset(robot_time, 0, sizeof(robot_time));
+    memset(robot_steps, 0, sizeof(engine_storage.robot_steps));
+    memset(robot_time, 0, sizeof(engine_storage.robot_time));
     
     // Reset robot states
     initialize_robot_states();
     
     // Clear existing robots
     robot_count = 0;
-    memset(robot_field, 0, sizeof(robot_field));
+    robot_field.clear();
     
     // Ensure the door cell is set correctly at the start position
     // set_cell(start_pos.x, start_pos.y, start_pos.z, 4);
@@ -1396,3 +2147,57 @@ extern "C" void reset_simulation() {
     // Recalculate available cells
     bfs();
 }
+
+// Metrics of a finished simulation
+struct RunMetrics {
+    int makespan;
+    int t_max;
+    int t_total;
+    int e_max;
+    int e_total;
+    int available_cells;
+};
+
+// The synchronous (p = 100) run of a baked in map is fully deterministic, so its
+// metrics are kept per map and external direction after the first run
+struct SyncMemoEntry {
+    bool valid;
+    RunMetrics metrics;
+};
+
+SyncMemoEntry sync_memo[WasmMaps::ALL_MAPS_COUNT][DIR_COUNT];
+
+// Run the synchronous simulation of a map to completion and leave its metrics in
+// the metric getters. When the run is already memoized the map is only loaded,
+// so the grid and the size getters belong to the same map as the restored
+// metrics, but the robots stay at the start. Returns 1 on a memo hit, 0 after a
+// run and -1 for an invalid map index.
+extern "C" int run_synchronous(int map_index) {
+    if (map_index < 0 || map_index >= WasmMaps::ALL_MAPS_COUNT) {
+        return -1;
+    }
+
+    SyncMemoEntry& entry = sync_memo[map_index][g_external_direction];
+    if (entry.valid) {
+        load_map(map_index);
+        makespan = entry.metrics.makespan;
+        t_max = entry.metrics.t_max;
+        t_total = entry.metrics.t_total;
+        e_max = entry.metrics.e_max;
+        e_total = entry.metrics.e_total;
+        available_cells = entry.metrics.available_cells;
+        simulation_steps = makespan;
+        simulation_complete = true;
+        return 1;
+    }
+
+    int previous_probability = g_active_probability;
+    load_map(map_index);
+    set_active_probability(100);
+    simulate_steps(SIMULATE_UNTIL_COMPLETE);
+    set_active_probability(previous_probability);
+
+    entry.metrics = {makespan, t_max, t_total, e_max, e_total, available_cells};
+    entry.valid = true;
+    return 0;
+}
@@ -0,0 +1,106 @@
+#ifndef MAPGEN_H
+#define MAPGEN_H
+
+// Random map generator for the native benchmarks. The maps are produced in the
+// packed bit format of maps.h, so they can be loaded with load_map_info.
+
+#include <random>
+#include <string>
+#include <vector>
+#include "maps.h"
+
+namespace MapGen {
+
+struct GeneratedMap {
+    std::string name;
+    int size_x = 0;
+    int size_y = 0;
+    int size_z = 0;
+    WasmMaps::Vec3 start = {0, 0, 0};
+    std::vector<unsigned char> data;
+    int walkable_cells = 0;
+
+    WasmMaps::MapInfo info() const {
+        return {name.c_str(), size_x, size_y, size_z, start, data.data(), (int)data.size()};
+    }
+};
+
+// Full height columns (along y) on a size_x * size_z footprint. The columns are
+// added one by one, only next to exactly one existing column, so their side
+// adjacency graph stays a tree, which is the class of maps the algorithm is
+// guaranteed to work on. Growing stops when `fill` of the footprint is used or
+// when no column can be added without closing a cycle.
+inline GeneratedMap columnTree(int size_x, int size_y, int size_z, double fill, unsigned seed) {
+    GeneratedMap result;
+    result.name = "column_tree_" + std::to_string(size_x) + "x" + std::to_string(size_y) + "x" +
+                  std::to_string(size_z) + "_" + std::to_string(seed);
+    result.size_x = size_x;
+    result.size_y = size_y;
+    result.size_z = size_z;
+
+    std::mt19937 rng(seed);
+    std::vector<char> used(size_x * size_z, 0);
+    std::vector<char> used_neighbors(size_x * size_z, 0);
+    std::vector<int> frontier;
+    int column_count = 0;
+
+    auto add_column = [&](int column) {
+        used[column] = 1;
+        column_count++;
+        int x = column / size_z;
+        int z = column % size_z;
+        const int dx[4] = {1, -1, 0, 0};
+        const int dz[4] = {0, 0, 1, -1};
+        for (int i = 0; i < 4; i++) {
+            int nx = x + dx[i];
+            int nz = z + dz[i];
+            if (nx < 0 || nx >= size_x || nz < 0 || nz >= size_z) continue;
+            int neighbor = nx * size_z + nz;
+            used_neighbors[neighbor]++;
+            if (!used[neighbor] && used_neighbors[neighbor] == 1) {
+                frontier.push_back(neighbor);
+            }
+        }
+    };
+
+    int root_x = std::uniform_int_distribution<int>(0, size_x - 1)(rng);
+    int root_z = std::uniform_int_distribution<int>(0, size_z - 1)(rng);
+    add_column(root_x * size_z + root_z);
+
+    int target = (int)(fill * size_x * size_z);
+    while (column_count < target && !frontier.empty()) {
+        int pick = std::uniform_int_distribution<int>(0, (int)frontier.size() - 1)(rng);
+        int column = frontier[pick];
+        frontier[pick] = frontier.back();
+        frontier.pop_back();
+
+        // Entries go stale once a second neighbor is added, skip those
+        if (used[column] || used_neighbors[column] != 1) continue;
+        add_column(column);
+    }
+
+    // Same bit order as convert.py: z, then y, then x, 1 = walkable
+    long long cell_count = (long long)size_x * size_y * size_z;
+    result.data.assign((cell_count + 7) / 8, 0);
+    long long bit = 0;
+    for (int z = 0; z < size_z; z++) {
+        for (int y = 0; y < size_y; y++) {
+            for (int x = 0; x < size_x; x++) {
+                if (used[x * size_z + z]) {
+                    result.data[bit / 8] |= (unsigned char)(1 << (bit % 8));
+                }
+                bit++;
+            }
+        }
+    }
+    result.walkable_cells = column_count * size_y;
+
+    // The door is at the bottom of the root column. load_map_info swaps x and z
+    // of the start (see set_start_position), so store it swapped.
+    result.start = {root_z, 0, root_x};
+    return result;
+}
+
+} // namespace MapGen
+
+#endif // MAPGEN_H
@@ -0,0 +1,212 @@
+#ifndef NEIGHBORHOOD_H
+#define NEIGHBORHOOD_H
+
+// 3x3x3 neighborhood of a cell as bit masks. Bit i*9 + j*3 + k is the cell at
+// relative offset (i-1, j-1, k-1), the same order as Robot::neighbors_index.
+//
+// The kernels gather the neighborhood from a byte field holding one CellState
+// per cell (WALL = 0, OCCUPIED = 1, FREE = 2) with a wall border around the grid
+// and classify it with a few vector compares. The instruction set is picked at
+// build time: AVX2 or SSE4.1 natively (-march=native), simd128 for the browser
+// build (-msimd128). Define NEIGHBORHOOD_SCALAR to force the scalar kernel.
+
+#if !defined(NEIGHBORHOOD_SCALAR) && defined(__AVX2__)
+#define NEIGHBORHOOD_KERNEL_AVX2
+#include <immintrin.h>
+#elif !defined(NEIGHBORHOOD_SCALAR) && defined(__SSE4_1__)
+#define NEIGHBORHOOD_KERNEL_SSE41
+#include <immintrin.h>
+#elif !defined(NEIGHBORHOOD_SCALAR) && defined(__wasm_simd128__)
+#define NEIGHBORHOOD_KERNEL_SIMD128
+#include <wasm_simd128.h>
+#else
+#define NEIGHBORHOOD_KERNEL_SCALAR
+#endif
+
+constexpr unsigned NEIGHBORHOOD_ALL = (1u << 27) - 1;
+constexpr int NEIGHBORHOOD_CENTER = 13;
+constexpr unsigned NEIGHBORHOOD_CENTER_BIT = 1u << NEIGHBORHOOD_CENTER;
+
+// Cells of the neighborhood where the given coordinate (0 = i, 1 = j, 2 = k) has the given value
+constexpr unsigned neighborhood_layer(int axis, int value) {
+    unsigned mask = 0;
+    for (int index = 0; index < 27; index++) {
+        int coords[3] = {index / 9, (index / 3) % 3, index % 3};
+        if (coords[axis] == value) mask |= 1u << index;
+    }
+    return mask;
+}
+
+struct Neighborhood {
+    unsigned wall;
+    unsigned occupied;
+    unsigned free;
+
+    CellState at(int index) const {
+        unsigned bit = 1u << index;
+        if (wall & bit) return WALL;
+        if (occupied & bit) return OCCUPIED;
+        return FREE;
+    }
+
+    bool operator==(const Neighborhood& other) const {
+        return wall == other.wall && occupied == other.occupied && free == other.free;
+    }
+};
+
+// Cells reachable from `seed` through face adjacent steps, only entering `open` cells
+inline unsigned neighborhood_flood(unsigned seed, unsigned open) {
+    constexpr unsigned not_k0 = NEIGHBORHOOD_ALL & ~neighborhood_layer(2, 0);
+    constexpr unsigned not_k2 = NEIGHBORHOOD_ALL & ~neighborhood_layer(2, 2);
+    constexpr unsigned not_j0 = NEIGHBORHOOD_ALL & ~neighborhood_layer(1, 0);
+    constexpr unsigned not_j2 = NEIGHBORHOOD_ALL & ~neighborhood_layer(1, 2);
+
+    unsigned reach = seed & open;
+    while (true) {
+        unsigned grown = reach
+            | ((reach & not_k2) << 1) | ((reach & not_k0) >> 1)
+            | ((reach & not_j2) << 3) | ((reach & not_j0) >> 3)
+            | (reach << 9) | (reach >> 9);
+        grown &= open;
+        if (grown == reach) return reach;
+        reach = grown;
+    }
+}
+
+// Reads 4 bytes of a row, the field has slack after its last cell for this
+inline unsigned neighborhood_load_row(const unsigned char* row) {
+    unsigned value;
+    __builtin_memcpy(&value, row, 4);
+    return value;
+}
+
+// Scalar classification of the three cells of one row starting at bit `shift`
+inline void neighborhood_classify_row(const unsigned char* row, int shift, Neighborhood& result) {
+    for (int k = 0; k < 3; k++) {
+        if (row[k] == WALL) result.wall |= 1u << (shift + k);
+        else if (row[k] == OCCUPIED) result.occupied |= 1u << (shift + k);
+    }
+}
+
+// `corner` points at the (-1, -1, -1) cell, rows follow with the given strides
+inline Neighborhood gather_neighborhood_scalar(const unsigned char* corner, int stride_x, int stride_y) {
+    Neighborhood result = {0, 0, 0};
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            neighborhood_classify_row(corner + i * stride_x + j * stride_y, i * 9 + j * 3, result);
+        }
+    }
+    result.free = NEIGHBORHOOD_ALL & ~(result.wall | result.occupied);
+    return result;
+}
+
+#if defined(NEIGHBORHOOD_KERNEL_SSE41) || defined(NEIGHBORHOOD_KERNEL_AVX2)
+
+// Drops the 4th byte of every 32-bit lane, 4 rows end up in the low 12 bytes
+inline __m128i neighborhood_pack_rows(__m128i rows) {
+    const __m128i pack = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    return _mm_shuffle_epi8(rows, pack);
+}
+
+inline unsigned neighborhood_mask_of(__m128i packed, char state) {
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(packed, _mm_set1_epi8(state))) & 0xfff;
+}
+
+#endif
+
+#if defined(NEIGHBORHOOD_KERNEL_SSE41)
+
+inline Neighborhood gather_neighborhood(const unsigned char* corner, int stride_x, int stride_y) {
+    const unsigned char* r0 = corner;
+    const unsigned char* r3 = corner + stride_x;
+    const unsigned char* r6 = corner + 2 * stride_x;
+
+    // Rows 0-3 and 4-7, row 8 is classified on its own
+    __m128i low = neighborhood_pack_rows(_mm_setr_epi32(
+        (int)neighborhood_load_row(r0), (int)neighborhood_load_row(r0 + stride_y),
+        (int)neighborhood_load_row(r0 + 2 * stride_y), (int)neighborhood_load_row(r3)));
+    __m128i high = neighborhood_pack_rows(_mm_setr_epi32(
+        (int)neighborhood_load_row(r3 + stride_y), (int)neighborhood_load_row(r3 + 2 * stride_y),
+        (int)neighborhood_load_row(r6), (int)neighborhood_load_row(r6 + stride_y)));
+
+    Neighborhood result;
+    result.wall = neighborhood_mask_of(low, WALL) | (neighborhood_mask_of(high, WALL) << 12);
+    result.occupied = neighborhood_mask_of(low, OCCUPIED) | (neighborhood_mask_of(high, OCCUPIED) << 12);
+    neighborhood_classify_row(r6 + 2 * stride_y, 24, result);
+    result.free = NEIGHBORHOOD_ALL & ~(result.wall | result.occupied);
+    return result;
+}
+
+#elif defined(NEIGHBORHOOD_KERNEL_AVX2)
+
+inline Neighborhood gather_neighborhood(const unsigned char* corner, int stride_x, int stride_y) {
+    const unsigned char* r0 = corner;
+    const unsigned char* r3 = corner + stride_x;
+    const unsigned char* r6 = corner + 2 * stride_x;
+
+    // Rows 0-3 in the low lane and 4-7 in the high lane, row 8 is classified on its own
+    __m256i rows = _mm256_setr_epi32(
+        (int)neighborhood_load_row(r0), (int)neighborhood_load_row(r0 + stride_y),
+        (int)neighborhood_load_row(r0 + 2 * stride_y), (int)neighborhood_load_row(r3),
+        (int)neighborhood_load_row(r3 + stride_y), (int)neighborhood_load_row(r3 + 2 * stride_y),
+        (int)neighborhood_load_row(r6), (int)neighborhood_load_row(r6 + stride_y));
+    const __m256i pack = _mm256_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    __m256i packed = _mm256_shuffle_epi8(rows, pack);
+
+    // The lanes are packed separately, bits 16-27 of the movemask hold rows 4-7
+    auto mask_of = [&](char state) {
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(packed, _mm256_set1_epi8(state)));
+        return (mask & 0xfff) | ((mask >> 4) & 0xfff000);
+    };
+
+    Neighborhood result;
+    result.wall = mask_of(WALL);
+    result.occupied = mask_of(OCCUPIED);
+    neighborhood_classify_row(r6 + 2 * stride_y, 24, result);
+    result.free = NEIGHBORHOOD_ALL & ~(result.wall | result.occupied);
+    return result;
+}
+
+#elif defined(NEIGHBORHOOD_KERNEL_SIMD128)
+
+inline v128_t neighborhood_pack_rows(v128_t rows) {
+    // Out of range indices select zero
+    return wasm_i8x16_swizzle(rows, wasm_i8x16_make(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 16, 16, 16, 16));
+}
+
+inline unsigned neighborhood_mask_of(v128_t packed, char state) {
+    return (unsigned)wasm_i8x16_bitmask(wasm_i8x16_eq(packed, wasm_i8x16_splat(state))) & 0xfff;
+}
+
+inline Neighborhood gather_neighborhood(const unsigned char* corner, int stride_x, int stride_y) {
+    const unsigned char* r0 = corner;
+    const unsigned char* r3 = corner + stride_x;
+    const unsigned char* r6 = corner + 2 * stride_x;
+
+    // Rows 0-3 and 4-7, row 8 is classified on its own
+    v128_t low = neighborhood_pack_rows(wasm_u32x4_make(
+        neighborhood_load_row(r0), neighborhood_load_row(r0 + stride_y),
+        neighborhood_load_row(r0 + 2 * stride_y), neighborhood_load_row(r3)));
+    v128_t high = neighborhood_pack_rows(wasm_u32x4_make(
+        neighborhood_load_row(r3 + stride_y), neighborhood_load_row(r3 + 2 * stride_y),
+        neighborhood_load_row(r6), neighborhood_load_row(r6 + stride_y)));
+
+    Neighborhood result;
+    result.wall = neighborhood_mask_of(low, WALL) | (neighborhood_mask_of(high, WALL) << 12);
+    result.occupied = neighborhood_mask_of(low, OCCUPIED) | (neighborhood_mask_of(high, OCCUPIED) << 12);
+    neighborhood_classify_row(r6 + 2 * stride_y, 24, result);
+    result.free = NEIGHBORHOOD_ALL & ~(result.wall | result.occupied);
+    return result;
+}
+
+#else
+
+inline Neighborhood gather_neighborhood(const unsigned char* corner, int stride_x, int stride_y) {
+    return gather_neighborhood_scalar(corner, stride_x, stride_y);
+}
+
+#endif
+
+#endif // NEIGHBORHOOD_H
@@ -0,0 +1,178 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+// Hardware performance counters for the native CLI, read through a single
+// perf_event_open group so that all events cover the same instructions. The
+// counts are attributed to the phases of the step profiler (profiler.h) with
+// its phase hook. Only available on Linux; when the kernel does not allow the
+// counters (perf_event_paranoid, containers, VMs) the group reports why and the
+// CLI skips the report.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace PerfCounters {
+
+enum Event {
+    CYCLES,
+    INSTRUCTIONS,
+    CACHE_REFERENCES,
+    CACHE_MISSES,
+    BRANCHES,
+    BRANCH_MISSES,
+    EVENT_COUNT
+};
+
+inline const char* eventName(int event) {
+    const char* names[EVENT_COUNT] = {"cycles", "instructions", "cache-references", "cache-misses", "branches", "branch-misses"};
+    return names[event];
+}
+
+struct Group {
+    int fds[EVENT_COUNT];
+    int slots[EVENT_COUNT]; // Position of the event in the group read, -1 if it could not be opened
+    int opened = 0;
+    std::string error;
+    bool permission_denied = false;
+
+    Group() {
+        for (int i = 0; i < EVENT_COUNT; i++) {
+            fds[i] = -1;
+            slots[i] = -1;
+        }
+    }
+
+    ~Group() {
+        close();
+    }
+
+    bool available() const {
+        return opened > 0;
+    }
+
+    // Opens the events that the machine supports, fails only if none of them could be opened
+    bool open() {
+#ifdef __linux__
+        const uint64_t configs[EVENT_COUNT] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES};
+        int leader = -1;
+        for (int i = 0; i < EVENT_COUNT; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = leader == -1 ? 1 : 0;
+            attr.exclude_kernel = 1; // Allowed with perf_event_paranoid <= 2
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+
+            int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fd < 0) {
+                if (error.empty()) error = std::string(eventName(i)) + ": " + strerror(errno);
+                if (errno == EACCES || errno == EPERM) permission_denied = true;
+                continue;
+            }
+            if (leader == -1) leader = fd;
+            fds[i] = fd;
+            slots[i] = opened++;
+        }
+        if (leader == -1) {
+            return false;
+        }
+        ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        return true;
+#else
+        error = "hardware counters are only supported on Linux";
+        return false;
+#endif
+    }
+
+    void close() {
+#ifdef __linux__
+        for (int i = 0; i < EVENT_COUNT; i++) {
+            if (fds[i] >= 0) ::close(fds[i]);
+            fds[i] = -1;
+            slots[i] = -1;
+        }
+#endif
+        opened = 0;
+    }
+
+    // Current values of all events, the ones that are not available read as 0
+    bool read(uint64_t values[EVENT_COUNT]) const {
+        for (int i = 0; i < EVENT_COUNT; i++) values[i] = 0;
+#ifdef __linux__
+        if (!available()) return false;
+        uint64_t buffer[1 + EVENT_COUNT];
+        int leader = -1;
+        for (int i = 0; i < EVENT_COUNT && leader == -1; i++) leader = fds[i];
+        if (::read(leader, buffer, sizeof(buffer)) < (ssize_t)((1 + opened) * sizeof(uint64_t))) return false;
+        for (int i = 0; i < EVENT_COUNT; i++) {
+            if (slots[i] >= 0) values[i] = buffer[1 + slots[i]];
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+};
+
+// Counts per phase of the step profiler. The hook is only called for the
+// phases timed once per step (the sampled per robot phases count to
+// PHASE_ROBOTS), and these follow each other, so the read at the end of a phase
+// is the start of the next one: 5 reads per step for the 4 phases. The few
+// statements between two phases count to the later one.
+struct PhaseCounts {
+    Group group;
+    uint64_t start[EVENT_COUNT];
+    uint64_t totals[PHASE_COUNT][EVENT_COUNT];
+    bool chained = false; // start holds the end of the previous phase of the step
+
+    PhaseCounts() {
+        memset(start, 0, sizeof(start));
+        memset(totals, 0, sizeof(totals));
+    }
+
+    void begin(ProfilePhase phase) {
+        // The first phase starts a step, the time since the last step is not counted
+        if (phase == PHASE_CELL_STATES || !chained) group.read(start);
+    }
+
+    void end(ProfilePhase phase) {
+        uint64_t now[EVENT_COUNT];
+        chained = group.read(now);
+        if (!chained) return;
+        for (int i = 0; i < EVENT_COUNT; i++) {
+            totals[phase][i] += now[i] - start[i];
+            start[i] = now[i];
+        }
+    }
+};
+
+// The profiler hook takes a plain function pointer, so the counts live here
+inline PhaseCounts* active_phase_counts = nullptr;
+
+inline void phaseHook(ProfilePhase phase, bool begin) {
+    if (!active_phase_counts) return;
+    if (begin) {
+        active_phase_counts->begin(phase);
+    } else {
+        active_phase_counts->end(phase);
+    }
+}
+
+} // namespace PerfCounters
+
+#endif // PERF_COUNTERS_H
@@ -0,0 +1,194 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Phase timers and counters of simulate_step. The instrumentation is only
+// compiled in with -DENABLE_PROFILER (make PROFILE=1), otherwise the PROFILE_*
+// macros expand to nothing and the getters report zeros.
+//
+// A neighborhood gather takes a few ns, less than a clock read, so the per
+// robot phases are sampled: natively every PROFILE_SAMPLE_INTERVAL-th gather
+// and lookCompute call is timed, and the phase gets the mean time of the
+// sampled calls times the calls of the step. The robot loop itself is timed
+// once per step, PHASE_ROBOTS keeps the rest of it. The wasm clock
+// (performance.now()) is too coarse for sampling, there PHASE_ROBOTS holds the
+// whole loop and the per robot phases stay 0.
+
+enum ProfilePhase {
+    PHASE_CELL_STATES,   // Cell state refresh
+    PHASE_NEIGHBORS,     // Neighborhood gathers (sampled)
+    PHASE_LOOK_COMPUTE,  // Robot::lookCompute (sampled)
+    PHASE_ROBOTS,        // Rest of the robot loop, the whole loop without sampling
+    PHASE_MOVE,          // Move loop and metric updates
+    PHASE_ROBOT_FIELD,   // generateRobotField
+    PHASE_COUNT
+};
+
+const int PROFILE_SAMPLE_INTERVAL = 16; // Power of two
+
+enum ProfileCounter {
+    COUNTER_ACTIVATIONS,   // lookCompute calls
+    COUNTER_SETTLE_CHECKS, // lookCompute calls that checked the neighborhood connectivity
+    COUNTER_REACHABLE,     // Reachability flood fills
+    COUNTER_MOVES,         // Robots that changed their position
+    COUNTER_COLLISIONS,    // Robots that ended up on an already taken cell
+    COUNTER_COUNT
+};
+
+struct Profiler {
+    // Values of the last step
+    double phase_ns[PHASE_COUNT];
+    int counters[COUNTER_COUNT];
+
+    // Sums over all steps since the last reset
+    double total_phase_ns[PHASE_COUNT];
+    double total_counters[COUNTER_COUNT];
+    int steps;
+
+    // Sampled phases: calls of the step, and the calls and time of the samples since the last reset
+    int calls[PHASE_COUNT];
+    unsigned int sample_clock[PHASE_COUNT];
+    double sampled_calls[PHASE_COUNT];
+    double sampled_ns[PHASE_COUNT];
+
+    // Called at the start and at the end of every timed phase, e.g. to read hardware counters
+    // (perf_counters.h). Not called for the samples, their work counts to PHASE_ROBOTS.
+    void (*phase_hook)(ProfilePhase phase, bool begin);
+
+    void reset() {
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            phase_ns[i] = 0;
+            total_phase_ns[i] = 0;
+            calls[i] = 0;
+            sample_clock[i] = 0;
+            sampled_calls[i] = 0;
+            sampled_ns[i] = 0;
+        }
+        for (int i = 0; i < COUNTER_COUNT; i++) {
+            counters[i] = 0;
+            total_counters[i] = 0;
+        }
+        steps = 0;
+    }
+
+    void beginStep() {
+        for (int i = 0; i < PHASE_COUNT; i++) {
+            phase_ns[i] = 0;
+            calls[i] = 0;
+        }
+        for (int i = 0; i < COUNTER_COUNT; i++) counters[i] = 0;
+    }
+
+    // True for the calls of a sampled phase that are timed
+    bool sample(ProfilePhase phase) {
+        calls[phase]++;
+        return (sample_clock[phase]++ & (PROFILE_SAMPLE_INTERVAL - 1)) == 0;
+    }
+
+    // Moves the estimated time of the sampled phases out of the robot loop. The
+    // estimates are capped at the measured loop time, so the phases still add up
+    // to the step time.
+    void attributeSamples() {
+        const ProfilePhase sampled[] = {PHASE_NEIGHBORS, PHASE_LOOK_COMPUTE};
+        double estimate[2];
+        double sum = 0;
+        for (int i = 0; i < 2; i++) {
+            ProfilePhase phase = sampled[i];
+            estimate[i] = sampled_calls[phase] > 0 ? calls[phase] * sampled_ns[phase] / sampled_calls[phase] : 0;
+            sum += estimate[i];
+        }
+        double scale = sum > phase_ns[PHASE_ROBOTS] ? phase_ns[PHASE_ROBOTS] / sum : 1.0;
+        for (int i = 0; i < 2; i++) {
+            phase_ns[sampled[i]] = estimate[i] * scale;
+            phase_ns[PHASE_ROBOTS] -= estimate[i] * scale;
+        }
+    }
+
+    void endStep() {
+        attributeSamples();
+        for (int i = 0; i < PHASE_COUNT; i++) total_phase_ns[i] += phase_ns[i];
+        for (int i = 0; i < COUNTER_COUNT; i++) total_counters[i] += counters[i];
+        steps++;
+    }
+};
+
+inline Profiler g_profiler;
+
+#ifdef ENABLE_PROFILER
+
+#if defined(__EMSCRIPTEN__) || defined(NO_STD_LIB)
+// Imported from JS, performance.now() in milliseconds
+extern "C" double profiler_now();
+
+inline double profiler_now_ns() {
+    return profiler_now() * 1e6;
+}
+#else
+#include <time.h>
+
+// clock_gettime goes through the vDSO, no system call
+inline double profiler_now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+#define PROFILER_SAMPLING
+#endif
+
+// Adds the time until the end of the enclosing scope to a phase
+struct ProfileScope {
+    ProfilePhase phase;
+    double start;
+
+    ProfileScope(ProfilePhase phase) : phase(phase) {
+        if (g_profiler.phase_hook) g_profiler.phase_hook(phase, true);
+        start = profiler_now_ns();
+    }
+
+    ~ProfileScope() {
+        g_profiler.phase_ns[phase] += profiler_now_ns() - start;
+        if (g_profiler.phase_hook) g_profiler.phase_hook(phase, false);
+    }
+};
+
+#ifdef PROFILER_SAMPLING
+// Times the enclosing scope if its call is one of the samples of the phase
+struct ProfileSample {
+    ProfilePhase phase;
+    double start;
+
+    ProfileSample(ProfilePhase phase) : phase(phase), start(-1) {
+        if (g_profiler.sample(phase)) start = profiler_now_ns();
+    }
+
+    ~ProfileSample() {
+        if (start < 0) return;
+        g_profiler.sampled_ns[phase] += profiler_now_ns() - start;
+        g_profiler.sampled_calls[phase]++;
+    }
+};
+#endif
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(phase) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(phase)
+#ifdef PROFILER_SAMPLING
+#define PROFILE_SAMPLE(phase) ProfileSample PROFILE_CONCAT(profile_sample_, __LINE__)(phase)
+#else
+#define PROFILE_SAMPLE(phase)
+#endif
+#define PROFILE_COUNT(counter, n) (g_profiler.counters[counter] += (n))
+#define PROFILE_STEP_BEGIN() g_profiler.beginStep()
+#define PROFILE_STEP_END() g_profiler.endStep()
+
+#else
+
+#define PROFILE_SCOPE(phase)
+#define PROFILE_SAMPLE(phase)
+#define PROFILE_COUNT(counter, n)
+#define PROFILE_STEP_BEGIN()
+#define PROFILE_STEP_END()
+
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,259 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Constant memory aggregation of the replicate metrics in the native tools.
+// Every aggregate can be merged with another one, so partial results of
+// workers or shards combine to exactly the result of a single sequential run.
+
+#include <cmath>
+#include <cstdint>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <vector>
+
+namespace Stats {
+
+// Binary form of the aggregates for partial result files: unsigned LEB128
+// varints, signed values zigzag encoded
+inline void writeVarint(std::ostream& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.put((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.put((char)value);
+}
+
+inline bool readVarint(std::istream& in, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+inline void writeSigned(std::ostream& out, int64_t value) {
+    writeVarint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+inline bool readSigned(std::istream& in, int64_t& value) {
+    uint64_t encoded;
+    if (!readVarint(in, encoded)) return false;
+    value = (int64_t)(encoded >> 1) ^ -(int64_t)(encoded & 1);
+    return true;
+}
+
+// Two sided 95% critical value of Student's t distribution
+inline double tCritical95(uint64_t dof) {
+    static const double table[30] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (dof == 0) return std::numeric_limits<double>::infinity();
+    if (dof <= 30) return table[dof - 1];
+    // Cornish-Fisher expansion around the normal quantile
+    const double z = 1.959964;
+    return z + (z * z * z + z) / (4.0 * dof);
+}
+
+// Count, mean and variance of integer metrics from exact sums (128 bit for the
+// squares), exact min and max. Unlike a floating point update (Welford) the
+// result does not depend on the order of the values or of the merges.
+struct Summary {
+    uint64_t count = 0;
+    int64_t sum = 0;
+    __int128 sum_squares = 0; // GCC and Clang, the native tools are built with them
+    int64_t min = std::numeric_limits<int64_t>::max();
+    int64_t max = std::numeric_limits<int64_t>::min();
+
+    // Adds `n` copies of the value
+    void add(int64_t value, uint64_t n = 1) {
+        count += n;
+        sum += value * (int64_t)n;
+        sum_squares += (__int128)value * value * n;
+        if (value < min) min = value;
+        if (value > max) max = value;
+    }
+
+    void merge(const Summary& other) {
+        count += other.count;
+        sum += other.sum;
+        sum_squares += other.sum_squares;
+        if (other.min < min) min = other.min;
+        if (other.max > max) max = other.max;
+    }
+
+    double mean() const {
+        return count > 0 ? (double)sum / count : 0.0;
+    }
+
+    // Sample variance, n * sum(x^2) - sum(x)^2 is exact in 128 bits
+    double variance() const {
+        if (count < 2) return 0.0;
+        __int128 scaled = (__int128)count * sum_squares - (__int128)sum * sum;
+        return (double)scaled / ((double)count * (count - 1));
+    }
+
+    double stddev() const {
+        return std::sqrt(variance());
+    }
+
+    // Width of the 95% confidence interval of the mean divided by the mean,
+    // infinite while there are too few values or the mean is 0
+    double relativeCiWidth() const {
+        if (count < 2 || sum == 0) return std::numeric_limits<double>::infinity();
+        return 2 * tCritical95(count - 1) * stddev() / std::sqrt((double)count) / std::abs(mean());
+    }
+
+    void write(std::ostream& out) const {
+        writeVarint(out, count);
+        writeSigned(out, sum);
+        writeVarint(out, (uint64_t)sum_squares);
+        writeVarint(out, (uint64_t)(sum_squares >> 64));
+        writeSigned(out, min);
+        writeSigned(out, max);
+    }
+
+    bool read(std::istream& in) {
+        uint64_t low, high;
+        if (!readVarint(in, count) || !readSigned(in, sum) || !readVarint(in, low) || !readVarint(in, high)) return false;
+        sum_squares = (__int128)(((unsigned __int128)high << 64) | low);
+        return readSigned(in, min) && readSigned(in, max);
+    }
+};
+
+// Quantile sketch with logarithmic buckets (DDSketch): every quantile is
+// within `RELATIVE_ACCURACY` of the true value. Merging adds the bucket counts,
+// so the result does not depend on how the values were split. The metrics are
+// non-negative, values <= 0 share a single bucket.
+struct QuantileSketch {
+    static constexpr double RELATIVE_ACCURACY = 0.005;
+
+    std::vector<uint64_t> buckets; // Counts of the bucket indices offset, offset + 1, ...
+    int offset = 0;
+    uint64_t zero_count = 0;
+    uint64_t count = 0;
+
+    static double gamma() {
+        return (1 + RELATIVE_ACCURACY) / (1 - RELATIVE_ACCURACY);
+    }
+
+    // Bucket i holds the values in (gamma^(i-1), gamma^i]
+    static int bucketIndex(double value) {
+        return (int)std::ceil(std::log(value) / std::log(gamma()));
+    }
+
+    void add(double value, uint64_t n = 1) {
+        count += n;
+        if (value <= 0) {
+            zero_count += n;
+            return;
+        }
+        addToBucket(bucketIndex(value), n);
+    }
+
+    void merge(const QuantileSketch& other) {
+        count += other.count;
+        zero_count += other.zero_count;
+        for (size_t i = 0; i < other.buckets.size(); i++) {
+            if (other.buckets[i]) addToBucket(other.offset + (int)i, other.buckets[i]);
+        }
+    }
+
+    // Estimate of the q-quantile (nearest rank), q in [0, 1]
+    double quantile(double q) const {
+        if (count == 0) return 0;
+        double nearest = std::ceil(q * count);
+        uint64_t rank = nearest > 1 ? (uint64_t)nearest - 1 : 0;
+        if (rank < zero_count) return 0;
+        uint64_t seen = zero_count;
+        for (size_t i = 0; i < buckets.size(); i++) {
+            seen += buckets[i];
+            if (seen > rank) {
+                // Point of the bucket with the same relative error to both ends
+                return 2 * std::pow(gamma(), offset + (int)i) / (gamma() + 1);
+            }
+        }
+        return 2 * std::pow(gamma(), offset + (int)buckets.size() - 1) / (gamma() + 1);
+    }
+
+    // Only the buckets between the first and the last non-empty one are stored
+    void write(std::ostream& out) const {
+        size_t first = 0, last = buckets.size();
+        while (first < last && buckets[first] == 0) first++;
+        while (last > first && buckets[last - 1] == 0) last--;
+        writeVarint(out, count);
+        writeVarint(out, zero_count);
+        writeSigned(out, offset + (int64_t)first);
+        writeVarint(out, last - first);
+        for (size_t i = first; i < last; i++) writeVarint(out, buckets[i]);
+    }
+
+    bool read(std::istream& in) {
+        int64_t first;
+        uint64_t size;
+        if (!readVarint(in, count) || !readVarint(in, zero_count) || !readSigned(in, first) || !readVarint(in, size)) {
+            return false;
+        }
+        if (size > (1u << 20)) return false; // Far more buckets than any range of int64 values needs
+        offset = (int)first;
+        buckets.assign(size, 0);
+        for (uint64_t& bucket : buckets) {
+            if (!readVarint(in, bucket)) return false;
+        }
+        return true;
+    }
+
+private:
+    void addToBucket(int index, uint64_t n) {
+        if (buckets.empty()) {
+            offset = index;
+            buckets.push_back(0);
+        } else if (index < offset) {
+            buckets.insert(buckets.begin(), offset - index, 0);
+            offset = index;
+        } else if (index >= offset + (int)buckets.size()) {
+            buckets.resize(index - offset + 1, 0);
+        }
+        buckets[index - offset] += n;
+    }
+};
+
+// Summary and quantiles of one metric
+struct Metric {
+    Summary summary;
+    QuantileSketch sketch;
+
+    void add(int64_t value, uint64_t n = 1) {
+        summary.add(value, n);
+        sketch.add((double)value, n);
+    }
+
+    void merge(const Metric& other) {
+        summary.merge(other.summary);
+        sketch.merge(other.sketch);
+    }
+
+    void write(std::ostream& out) const {
+        summary.write(out);
+        sketch.write(out);
+    }
+
+    bool read(std::istream& in) {
+        return summary.read(in) && sketch.read(in);
+    }
+
+    // Sketch estimate clamped to the exact range, so a constant metric reports its value
+    double quantile(double q) const {
+        if (summary.count == 0) return 0;
+        double value = sketch.quantile(q);
+        return value < summary.min ? (double)summary.min : value > summary.max ? (double)summary.max : value;
+    }
+};
+
+} // namespace Stats
+
+#endif // STATS_H
@@ -0,0 +1,335 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+// Parameter sweeps of the native CLI: (map, p, replicate) jobs, their split
+// into shards, the result file that makes an interrupted sweep resumable and
+// the worker pool that runs the jobs. The engine is a single set of globals
+// (like the WASM module), so the workers are forked processes that each own a
+// copy of it; they get jobs over a pipe and send the results back over a
+// shared one.
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "stats.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace Sweep {
+
+// Parses a comma separated list of values and inclusive ranges, e.g. "0,2" or "10:100:10"
+inline bool parseList(const std::string& text, std::vector<int>& values) {
+    std::stringstream stream(text);
+    std::string token;
+    while (std::getline(stream, token, ',')) {
+        int start, end, step = 1;
+        char colon1, colon2;
+        std::stringstream parts(token);
+        if (!(parts >> start)) return false;
+        end = start;
+        if (parts >> colon1) {
+            if (colon1 != ':' || !(parts >> end)) return false;
+            if (parts >> colon2 && (colon2 != ':' || !(parts >> step) || step <= 0)) return false;
+        }
+        for (int value = start; value <= end; value += step) {
+            values.push_back(value);
+        }
+    }
+    return !values.empty();
+}
+
+struct Job {
+    int map;
+    int p;
+    int replicate;
+};
+
+// Seed of a job, it only depends on the job, so results do not depend on the
+// worker that ran it or on the order of the jobs (SplitMix64 finalizer)
+inline uint32_t jobSeed(uint64_t base, int dir, const Job& job) {
+    uint64_t x = base ^ ((uint64_t)job.map << 48) ^ ((uint64_t)job.p << 40) ^ ((uint64_t)dir << 32) ^ (uint32_t)job.replicate;
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return (uint32_t)(x ^ (x >> 31));
+}
+
+// Shard i of n of a multi-node sweep
+struct Shard {
+    int index = 0;
+    int count = 1;
+};
+
+// Parses "i/n" with 0 <= i < n
+inline bool parseShard(const std::string& text, Shard& shard) {
+    char slash;
+    std::stringstream stream(text);
+    if (!(stream >> shard.index >> slash >> shard.count) || slash != '/' || !stream.eof()) return false;
+    return shard.count > 0 && shard.index >= 0 && shard.index < shard.count;
+}
+
+// Every job belongs to exactly one shard. The split only depends on the job, not
+// on the order of the lists, so the shards of a sweep can run with the same
+// command line on different machines.
+inline bool inShard(const Job& job, const Shard& shard) {
+    return jobSeed(0x5eed5eed5eed5eedull, 0, job) % shard.count == (uint64_t)shard.index;
+}
+
+// Binary partial aggregate of a shard, written at the end of a sharded sweep.
+// The points themselves are written by the caller after the header.
+constexpr char AGGREGATE_MAGIC[8] = {'U', 'D', 'P', 'S', 'W', 'P', 'A', '1'};
+
+struct AggregateHeader {
+    Shard shard;
+    uint64_t seed = 0;
+    int dir = 0;
+    int replicates = 0;
+    uint64_t points = 0;
+
+    void write(std::ostream& out) const {
+        out.write(AGGREGATE_MAGIC, sizeof(AGGREGATE_MAGIC));
+        Stats::writeVarint(out, shard.index);
+        Stats::writeVarint(out, shard.count);
+        Stats::writeVarint(out, seed);
+        Stats::writeVarint(out, dir);
+        Stats::writeVarint(out, replicates);
+        Stats::writeVarint(out, points);
+    }
+
+    bool read(std::istream& in) {
+        char magic[sizeof(AGGREGATE_MAGIC)];
+        if (!in.read(magic, sizeof(magic)) || std::string(magic, sizeof(magic)) != std::string(AGGREGATE_MAGIC, sizeof(magic))) {
+            return false;
+        }
+        uint64_t index, count, direction, reps;
+        if (!Stats::readVarint(in, index) || !Stats::readVarint(in, count) || !Stats::readVarint(in, seed) ||
+            !Stats::readVarint(in, direction) || !Stats::readVarint(in, reps) || !Stats::readVarint(in, points)) {
+            return false;
+        }
+        shard.index = (int)index;
+        shard.count = (int)count;
+        dir = (int)direction;
+        replicates = (int)reps;
+        return true;
+    }
+
+    // Shards of the same sweep, they can be merged
+    bool sameSweep(const AggregateHeader& other) const {
+        return shard.count == other.shard.count && seed == other.seed && dir == other.dir && replicates == other.replicates;
+    }
+};
+
+constexpr int VALUE_COUNT = 6;
+inline const char* valueName(int value) {
+    const char* names[VALUE_COUNT] = {"makespan", "e_total", "e_max", "t_total", "t_max", "available_cells"};
+    return names[value];
+}
+
+// Plain data, it is sent through the pipes as is
+struct Result {
+    Job job;
+    int dir;
+    uint32_t seed;
+    int values[VALUE_COUNT]; // In the order of valueName
+};
+
+// Tab separated results, one line per finished job. Lines are only counted when
+// they are complete, so a sweep that was killed mid-write resumes cleanly.
+class ResultFile {
+public:
+    // Reads the results already in the file, returns false if it can not be opened for appending
+    bool open(const std::string& path) {
+        std::string content;
+        {
+            std::ifstream in(path, std::ios::binary);
+            if (in) content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+
+        // Drop an incomplete last line before appending to the file
+        size_t complete = content.rfind('\n');
+        complete = complete == std::string::npos ? 0 : complete + 1;
+        if (complete != content.size()) {
+            std::ofstream rewrite(path, std::ios::binary | std::ios::trunc);
+            rewrite.write(content.data(), complete);
+            content.resize(complete);
+        }
+
+        std::stringstream lines(content);
+        std::string line;
+        while (std::getline(lines, line)) {
+            Result result;
+            if (parseLine(line, result)) results.push_back(result);
+        }
+
+        out.open(path, std::ios::app);
+        if (!out) return false;
+        if (complete == 0) {
+            out << "# map\tp\treplicate\tdir\tseed";
+            for (int i = 0; i < VALUE_COUNT; i++) out << "\t" << valueName(i);
+            out << "\n";
+        }
+        return true;
+    }
+
+    void append(const Result& result) {
+        out << result.job.map << "\t" << result.job.p << "\t" << result.job.replicate << "\t"
+            << result.dir << "\t" << result.seed;
+        for (int i = 0; i < VALUE_COUNT; i++) out << "\t" << result.values[i];
+        out << "\n";
+        out.flush();
+        results.push_back(result);
+    }
+
+    const std::vector<Result>& all() const {
+        return results;
+    }
+
+private:
+    static bool parseLine(const std::string& line, Result& result) {
+        if (line.empty() || line[0] == '#') return false;
+        std::stringstream fields(line);
+        if (!(fields >> result.job.map >> result.job.p >> result.job.replicate >> result.dir >> result.seed)) return false;
+        for (int i = 0; i < VALUE_COUNT; i++) {
+            if (!(fields >> result.values[i])) return false;
+        }
+        return true;
+    }
+
+    std::ofstream out;
+    std::vector<Result> results;
+};
+
+// Key of a job in the result file, a result only counts for the same external direction and seed
+inline std::tuple<int, int, int, int, uint32_t> resultKey(const Job& job, int dir, uint32_t seed) {
+    return std::make_tuple(job.map, job.p, job.replicate, dir, seed);
+}
+
+using JobRunner = std::function<void(const Job& job, Result& result)>;
+using ResultHandler = std::function<void(const Result& result)>;
+
+namespace detail {
+
+inline bool readFull(int fd, void* data, size_t size) {
+    char* bytes = (char*)data;
+    while (size > 0) {
+        ssize_t n = ::read(fd, bytes, size);
+        if (n <= 0) return false;
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+inline bool writeFull(int fd, const void* data, size_t size) {
+    const char* bytes = (const char*)data;
+    while (size > 0) {
+        ssize_t n = ::write(fd, bytes, size);
+        if (n <= 0) return false;
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+struct WorkerMessage {
+    int worker;
+    Result result;
+};
+
+} // namespace detail
+
+// Runs the jobs on `workers` forked processes, `run` is called in the workers and
+// `done` in the calling process as the results arrive (in completion order).
+// With a single worker the jobs run in this process. Returns false if a worker died.
+inline bool runPool(const std::vector<Job>& jobs, int workers, const JobRunner& run, const ResultHandler& done) {
+    if (workers <= 1 || jobs.size() <= 1) {
+        for (const Job& job : jobs) {
+            Result result;
+            run(job, result);
+            done(result);
+        }
+        return true;
+    }
+    if ((size_t)workers > jobs.size()) workers = (int)jobs.size();
+
+    // Messages are far below PIPE_BUF, so the writes of the workers never interleave
+    static_assert(sizeof(detail::WorkerMessage) < 512, "worker messages must be written atomically");
+    int results[2];
+    if (pipe(results) != 0) return false;
+
+    std::cout.flush();
+    std::vector<int> jobPipes(workers, -1);
+    std::vector<pid_t> pids(workers, -1);
+    for (int w = 0; w < workers; w++) {
+        int pipeFds[2];
+        if (pipe(pipeFds) != 0) return false;
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(pipeFds[1]);
+            close(results[0]);
+            for (int other = 0; other < w; other++) close(jobPipes[other]);
+            detail::WorkerMessage message;
+            message.worker = w;
+            Job job;
+            while (detail::readFull(pipeFds[0], &job, sizeof(job))) {
+                run(job, message.result);
+                if (!detail::writeFull(results[1], &message, sizeof(message))) break;
+            }
+            _exit(0);
+        }
+        close(pipeFds[0]);
+        jobPipes[w] = pipeFds[1];
+        pids[w] = pid;
+    }
+    close(results[1]);
+
+    // Two jobs in flight per worker, so a worker does not wait for the next one
+    std::vector<int> inFlight(workers, 0);
+    size_t next = 0;
+    auto dispatch = [&](int w) {
+        if (next < jobs.size()) {
+            detail::writeFull(jobPipes[w], &jobs[next++], sizeof(Job));
+            inFlight[w]++;
+        } else if (inFlight[w] == 0 && jobPipes[w] >= 0) {
+            close(jobPipes[w]);
+            jobPipes[w] = -1;
+        }
+    };
+    for (int round = 0; round < 2; round++) {
+        for (int w = 0; w < workers; w++) dispatch(w);
+    }
+
+    bool ok = true;
+    for (size_t received = 0; received < jobs.size(); received++) {
+        detail::WorkerMessage message;
+        if (!detail::readFull(results[0], &message, sizeof(message))) {
+            ok = false;
+            break;
+        }
+        done(message.result);
+        inFlight[message.worker]--;
+        dispatch(message.worker);
+    }
+
+    for (int w = 0; w < workers; w++) {
+        if (jobPipes[w] >= 0) close(jobPipes[w]);
+    }
+    close(results[0]);
+    for (pid_t pid : pids) {
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    return ok;
+}
+
+} // namespace Sweep
+
+#endif // SWEEP_H
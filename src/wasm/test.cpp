@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <string>
@@ -7,14 +8,11 @@
 
 // Sort of a unity build
 #include "main.cpp" 
+#include "stats.h"
 
 // Forward declaration for the reset function
 void resetTestEnvironment();
 
-extern "C" void console_log(int value) {
-    // std::cout << "Log: " << value << std::endl;
-}
-
 // Simple testing framework for C++ WebAssembly code
 class TestFramework {
 private:
@@ -70,22 +68,8 @@ public:
 
 // Helper function to clear global state between tests
 void resetTestEnvironment() {
-    // Use small dimensions for focused tests
-    height = 3;
-    width = 3;
-    depth = 3;
-    
-    // Reset map to all walls initially
-    for (int x = 0; x < MAX_SIZE; x++) {
-        for (int y = 0; y < MAX_SIZE; y++) {
-            for (int z = 0; z < MAX_SIZE; z++) {
-                map[x][y][z] = false; // All are walls initially
-            }
-        }
-    }
-    
-    memset(distances, 0, sizeof(distances));
-    memset(robot_field, 0, sizeof(robot_field));
+    // Use small dimensions for focused tests, this also resets the map to all walls
+    init_grid(3, 3, 3);
     robot_count = 0;
     start_pos = Vector3Int(0, 0, 0);
 
@@ -95,7 +79,7 @@ void resetTestEnvironment() {
     }
     
     // Make a small walkable area for basic tests (1x1x1 center surrounded by walls)
-    map[1][1][1] = true; // Make center cell walkable
+    map(1, 1, 1) = true; // Make center cell walkable
 }
 
 // Helper functions and test utilities
@@ -154,15 +138,15 @@ bool testRobotMovement() {
     for (int x = 0; x < 3; x++) {
         for (int y = 0; y < 3; y++) {
             for (int z = 0; z < 3; z++) {
-                map[x][y][z] = false; // All walls initially
+                map(x, y, z) = false; // All walls initially
             }
         }
     }
-    map[1][1][1] = true; // Center cell is walkable
+    map(1, 1, 1) = true; // Center cell is walkable
     
     Robot robot(Vector3Int(1, 1, 1));
     if (!assertVector3Equals(Vector3Int(1, 1, 1), robot.position, "Initial position check")) return false;
-    robot.setNextMoveDir(up);
+    robot.setNextMoveDir(DIR_UP);
     if (!assertVector3Equals(Vector3Int(1, 2, 1), robot.target, "Target position after setNextMoveDir")) return false;
     if (!assertTrue(robot.ever_moved, "ever_moved flag should be set after setNextMoveDir")) return false;
     robot.move();
@@ -176,11 +160,11 @@ bool testGenerateRobotField_MultipleRobotsSameLocation() {
     for (int x = 0; x < 3; x++) {
         for (int y = 0; y < 3; y++) {
             for (int z = 0; z < 3; z++) {
-                map[x][y][z] = false; // All walls initially
+                map(x, y, z) = false; // All walls initially
             }
         }
     }
-    map[1][1][1] = true; // Only center cell is walkable
+    map(1, 1, 1) = true; // Only center cell is walkable
     
     // Add multiple robots at the same location (1,1,1)
     robots[0] = Robot(Vector3Int(1, 1, 1)); robots[0].active = false; // Inactive
@@ -190,9 +174,9 @@ bool testGenerateRobotField_MultipleRobotsSameLocation() {
 
     generateRobotField(); // Should place only one robot in the field
 
-    if (!assertTrue(robot_field[1][1][1] != nullptr, "robot_field[1][1][1] should not be null")) return false;
+    if (!assertTrue(robot_field(1, 1, 1) != nullptr, "robot_field(1, 1, 1) should not be null")) return false;
     // It should pick the first one it encounters in the loop
-    if (!assertTrue(robot_field[1][1][1] == &robots[0], "robot_field should point to the first robot added at that location")) return false;
+    if (!assertTrue(robot_field(1, 1, 1) == &robots[0], "robot_field should point to the first robot added at that location")) return false;
     
     return true;
 }
@@ -203,26 +187,26 @@ bool testSimulateStep_NoActiveRobotCollision() {
     for (int x = 0; x < 3; x++) {
         for (int y = 0; y < 3; y++) {
             for (int z = 0; z < 3; z++) {
-                map[x][y][z] = false; // All walls initially
+                map(x, y, z) = false; // All walls initially
             }
         }
     }
     
     start_pos = Vector3Int(0, 0, 0); // Set door position
-    map[0][0][0] = true; // Door position is walkable
-    map[1][1][1] = true; // Target cell is walkable
-    map[1][0][1] = true; // Path for robot 0
-    map[0][1][1] = true; // Path for robot 1
+    map(0, 0, 0) = true; // Door position is walkable
+    map(1, 1, 1) = true; // Target cell is walkable
+    map(1, 0, 1) = true; // Path for robot 0
+    map(0, 1, 1) = true; // Path for robot 1
 
     // Add two robots targeting the same cell (1,1,1)
     robots[0] = Robot(Vector3Int(1, 0, 1)); // Start below target
     robots[0].active = true;
-    robots[0].kulso_irany = up; // Move up
+    robots[0].kulso_irany = DIR_UP; // Move up
     robots[0].target = Vector3Int(1, 1, 1); // Explicitly set target
 
     robots[1] = Robot(Vector3Int(0, 1, 1)); // Start left of target
     robots[1].active = true;
-    robots[1].kulso_irany = right; // Move right
+    robots[1].kulso_irany = DIR_RIGHT; // Move right
     robots[1].target = Vector3Int(1, 1, 1); // Explicitly set target
     
     robot_count = 2;
@@ -249,7 +233,7 @@ bool testSimulateStep_NoActiveRobotCollision() {
 
     // After the step, check the robot_field for collisions
     int activeRobotsAt_1_1_1 = 0;
-    if (robot_field[1][1][1] != nullptr && robot_field[1][1][1]->active) {
+    if (robot_field(1, 1, 1) != nullptr && robot_field(1, 1, 1)->active) {
         activeRobotsAt_1_1_1++;
     }
     // We need to check the actual positions in the robots array too, as generateRobotField might hide the issue
@@ -276,14 +260,14 @@ bool testGetCell_StackedRobots() {
     for (int x = 0; x < 3; x++) {
         for (int y = 0; y < 3; y++) {
             for (int z = 0; z < 3; z++) {
-                map[x][y][z] = false; // All walls initially
+                map(x, y, z) = false; // All walls initially
             }
         }
     }
     
     start_pos = Vector3Int(0, 0, 0);
-    map[0][0][0] = true; // Door position walkable
-    map[1][1][1] = true; // Test cell walkable
+    map(0, 0, 0) = true; // Door position walkable
+    map(1, 1, 1) = true; // Test cell walkable
 
     // Add robots with different states at (1,1,1)
     robots[0] = Robot(Vector3Int(1, 1, 1)); 
@@ -302,7 +286,7 @@ bool testGetCell_StackedRobots() {
 
     generateRobotField(); // Only robot 0 should be in the field
 
-    if (!assertTrue(robot_field[1][1][1] == &robots[0], "robot_field should contain the first robot (wall state)")) return false;
+    if (!assertTrue(robot_field(1, 1, 1) == &robots[0], "robot_field should contain the first robot (wall state)")) return false;
 
     // get_cell should report based on the robot in the field
     int cellType = get_cell(1, 1, 1);
@@ -327,25 +311,25 @@ bool testSimulateStep_RobotCollisionAvoidance() {
     for (int x = 0; x < 3; x++) {
         for (int y = 0; y < 3; y++) {
             for (int z = 0; z < 3; z++) {
-                map[x][y][z] = false; // All walls initially
+                map(x, y, z) = false; // All walls initially
             }
         }
     }
     
     start_pos = Vector3Int(0, 0, 0); // Set door position
-    map[0][0][0] = true; // Door position is walkable
-    map[1][1][1] = true; // Target cell is walkable
-    map[0][1][1] = true; // Path for robot 0
-    map[1][0][1] = true; // Path for robot 1
+    map(0, 0, 0) = true; // Door position is walkable
+    map(1, 1, 1) = true; // Target cell is walkable
+    map(0, 1, 1) = true; // Path for robot 0
+    map(1, 0, 1) = true; // Path for robot 1
     
     // Add two robots that will try to move to the same position (1,1,1)
     robots[0] = Robot(Vector3Int(0, 1, 1)); // Left of target
     robots[0].active = true;
-    robots[0].kulso_irany = right; // Will try to move right to (1,1,1)
+    robots[0].kulso_irany = DIR_RIGHT; // Will try to move right to (1,1,1)
     
     robots[1] = Robot(Vector3Int(1, 0, 1)); // Below target
     robots[1].active = true;
-    robots[1].kulso_irany = up; // Will try to move up to (1,1,1)
+    robots[1].kulso_irany = DIR_UP; // Will try to move up to (1,1,1)
     
     robot_count = 2;
     
@@ -371,9 +355,9 @@ bool testSimulateStep_RobotCollisionAvoidance() {
     
     // Check the robot_field is correctly updated
     if (robotsAt_1_1_1 == 1) {
-        if (!assertTrue(robot_field[1][1][1] != nullptr, "robot_field should have a robot at target position")) return false;
+        if (!assertTrue(robot_field(1, 1, 1) != nullptr, "robot_field should have a robot at target position")) return false;
     } else {
-        if (!assertTrue(robot_field[1][1][1] == nullptr, "robot_field should be null at target if no robot moved there")) return false;
+        if (!assertTrue(robot_field(1, 1, 1) == nullptr, "robot_field should be null at target if no robot moved there")) return false;
     }
 
     // Analyze which robots moved where
@@ -388,21 +372,22 @@ bool testSimulateStep_RobotCollisionAvoidance() {
 
 // Test for robot priority when moving to the same cell
 bool testRobotMovePriority() {
-    // Create a simple 3x3x3 map with specific walkable cells
+    // Create a simple 5x5x5 map with specific walkable cells
+    init_grid(5, 5, 5);
     for (int x = 0; x < 5; x++) {
         for (int y = 0; y < 5; y++) {
             for (int z = 0; z < 5; z++) {
-                map[x][y][z] = false; // All walls initially
+                map(x, y, z) = false; // All walls initially
             }
         }
     }
     
     // Set start position and make some cells walkable
     start_pos = Vector3Int(0, 0, 0);
-    map[0][0][0] = true; // Door position is walkable
-    map[1][1][1] = true; // Robot 0 start position
-    map[2][2][2] = true; // Target position
-    map[3][3][3] = true; // Robot 1 start position
+    map(0, 0, 0) = true; // Door position is walkable
+    map(1, 1, 1) = true; // Robot 0 start position
+    map(2, 2, 2) = true; // Target position
+    map(3, 3, 3) = true; // Robot 1 start position
     
     // We want to test a scenario where multiple robots try to move to the same position
     // This tests if there's priority given to robots added first
@@ -430,22 +415,280 @@ bool testRobotMovePriority() {
     generateRobotField();
     
     // Check if exactly one robot is in the robot_field at the target position
-    if (!assertTrue(robot_field[2][2][2] != nullptr, "One robot should be at the target position")) return false;
+    if (!assertTrue(robot_field(2, 2, 2) != nullptr, "One robot should be at the target position")) return false;
     
     // The first robot should win the race and be placed in the field
-    if (!assertTrue(robot_field[2][2][2] == &robots[0], "First robot added should take precedence")) return false;
+    if (!assertTrue(robot_field(2, 2, 2) == &robots[0], "First robot added should take precedence")) return false;
     
     // Log the positions
     std::cout << "\nRobot positions after movement conflict:\n";
     for (int i = 0; i < robot_count; i++) {
         std::cout << "Robot " << i << " at (" << robots[i].position.x << "," << robots[i].position.y << "," << robots[i].position.z << ")"
-                 << " - in field: " << (robot_field[robots[i].position.x][robots[i].position.y][robots[i].position.z] == &robots[i])
+                 << " - in field: " << (robot_field(robots[i].position.x, robots[i].position.y, robots[i].position.z) == &robots[i])
                  << std::endl;
     }
     
     return true;
 }
 
+// Test that the vectorized neighborhood gather matches the getCellState based one
+bool testNeighborhoodGatherMatchesScalar() {
+    load_map(0);
+    set_active_probability(100);
+
+    // Check a few states of the simulation, with free, occupied and settled cells
+    for (int step = 0; step < 40; step++) {
+        refresh_cell_states();
+        for (int x = 0; x < height; x++) {
+            for (int y = 0; y < width; y++) {
+                for (int z = 0; z < depth; z++) {
+                    Neighborhood simd = gatherNeighborhood(x, y, z);
+                    Neighborhood scalar = gatherNeighborhoodScalar(x, y, z);
+                    if (!assertEquals(scalar.wall, simd.wall, "wall mask")) return false;
+                    if (!assertEquals(scalar.occupied, simd.occupied, "occupied mask")) return false;
+                    if (!assertEquals(scalar.free, simd.free, "free mask")) return false;
+                }
+            }
+        }
+        simulate_step();
+    }
+    return true;
+}
+
+// Test that a memoized synchronous run reports the same metrics as the real one
+bool testSynchronousRunMemo() {
+    if (!assertEquals(0, run_synchronous(0), "first synchronous run should simulate")) return false;
+    RunMetrics first = {get_makespan(), get_t_max(), get_t_total(), get_e_max(), get_e_total(), get_available_cells()};
+    if (!assertTrue(is_simulation_complete(), "synchronous run should complete")) return false;
+
+    load_map(1);
+    simulate_step();
+    if (!assertEquals(1, run_synchronous(0), "second synchronous run should come from the memo")) return false;
+    if (!assertEquals(get_map_size_x(0), get_grid_size_x(), "a memo hit should load its map")) return false;
+    if (!assertEquals(first.makespan, get_makespan(), "makespan")) return false;
+    if (!assertEquals(first.t_total, get_t_total(), "t_total")) return false;
+    if (!assertEquals(first.e_total, get_e_total(), "e_total")) return false;
+    if (!assertEquals(first.available_cells, get_available_cells(), "available cells")) return false;
+    return assertEquals(-1, run_synchronous(-1), "invalid map index");
+}
+
+// Test that merged partial aggregates match a single sequential one
+bool testStatsMerge() {
+    Stats::Metric all, left, right;
+    for (int i = 1; i <= 1000; i++) {
+        int value = (i * 37) % 500 + 1;
+        all.add(value);
+        (i % 3 == 0 ? left : right).add(value);
+    }
+    left.merge(right);
+
+    if (!assertEquals((int)all.summary.count, (int)left.summary.count, "count")) return false;
+    if (!assertTrue(all.summary.mean() == left.summary.mean(), "mean")) return false;
+    if (!assertTrue(all.summary.variance() == left.summary.variance(), "variance")) return false;
+    if (!assertEquals(1, (int)left.summary.min, "min")) return false;
+    if (!assertEquals(500, (int)left.summary.max, "max")) return false;
+    // The values are uniform over 1..500
+    for (double q : {0.5, 0.9, 0.99}) {
+        if (!assertTrue(all.quantile(q) == left.quantile(q), "merged quantile")) return false;
+        if (!assertTrue(std::abs(left.quantile(q) - 500 * q) <= 500 * q * 0.005 + 1, "quantile accuracy")) return false;
+    }
+    return true;
+}
+
+// Test that seeking a recorded trajectory restores the robot field of every step
+bool testTrajectoryReplay() {
+    load_map(1);
+    set_active_probability(60);
+    if (!assertEquals(1, trajectory_start(), "recording should start")) return false;
+
+    // Robot index of every cell after every step
+    int cells = height * width * depth;
+    std::vector<std::vector<int>> fields;
+    auto captureField = [&]() {
+        std::vector<int> field(cells);
+        int i = 0;
+        for (int x = 0; x < height; x++)
+            for (int y = 0; y < width; y++)
+                for (int z = 0; z < depth; z++, i++)
+                    field[i] = robot_field(x, y, z) ? (int)(robot_field(x, y, z) - robots) : -1;
+        return field;
+    };
+    fields.push_back(captureField());
+    while (!is_simulation_complete()) {
+        simulate_step();
+        fields.push_back(captureField());
+    }
+    int size = trajectory_finish();
+    if (!assertTrue(size > 0, "trajectory should be written")) return false;
+
+    int steps = trajectory_open(size);
+    if (!assertEquals((int)fields.size() - 1, steps, "step count")) return false;
+    // Forward, backward and keyframe crossing seeks
+    for (int step : {0, 1, 2, steps / 2, 63, 64, 65, 10, steps, 129, steps - 1, 0}) {
+        if (!assertEquals(1, trajectory_seek(step), "seek should succeed")) return false;
+        if (!assertTrue(captureField() == fields[step], "robot field of step " + std::to_string(step))) return false;
+    }
+    for (int step = 0; step <= steps; step++) {
+        trajectory_seek(step);
+        if (!assertTrue(captureField() == fields[step], "robot field of step " + std::to_string(step))) return false;
+    }
+    return assertEquals(0, trajectory_open(size - 1) >= 0, "truncated data should be rejected");
+}
+
+bool testExportCells() {
+    load_map(1);
+    set_active_probability(60);
+    for (int step = 0; step < 40 && !is_simulation_complete(); step++) {
+        const unsigned char* cells = export_cells();
+        int i = 0;
+        for (int x = 0; x < height; x++)
+            for (int y = 0; y < width; y++)
+                for (int z = 0; z < depth; z++, i++)
+                    if (!assertEquals(get_cell(x, y, z), cells[i], "exported cell of step " + std::to_string(step))) return false;
+        simulate_step();
+    }
+    return true;
+}
+
+bool testDirtyCells() {
+    load_map(1);
+    set_active_probability(60);
+    int cells = height * width * depth;
+    const unsigned char* exported = export_cells();
+    std::vector<int> shown(exported, exported + cells);
+    int read = get_dirty_cell_head();
+    while (!is_simulation_complete()) {
+        simulate_step();
+        int head = get_dirty_cell_head();
+        if (!assertTrue(head - read <= get_dirty_cell_capacity(), "dirty ring should not overflow")) return false;
+        for (; read < head; read++) {
+            unsigned entry = get_dirty_cells()[read % get_dirty_cell_capacity()];
+            shown[entry >> 3] = entry & 7;
+        }
+        int i = 0;
+        for (int x = 0; x < height; x++)
+            for (int y = 0; y < width; y++)
+                for (int z = 0; z < depth; z++, i++)
+                    if (!assertEquals(get_cell(x, y, z), shown[i], "patched cell of step " + std::to_string(get_simulation_steps()))) return false;
+    }
+    reset_simulation();
+    return assertTrue(get_dirty_cell_head() - read > get_dirty_cell_capacity(), "reset should invalidate the readers");
+}
+
+bool testExportInstances() {
+    load_map(1);
+    set_active_probability(60);
+    for (int step = 0; step < 20; step++) simulate_step();
+    set_instance_style(2, 0.0f, 0.8f, 0.0f, 0.5f);
+    // Robots, settled and sleeping robots, empty cells are left out
+    int count = export_instances(0, (1u << 2) | (1u << 3) | (1u << 5));
+    int walls = export_instances(1, (1u << 1) | (1u << 4));
+    int expected = 0, expected_walls = 0, cell = 0;
+    for (int x = 0; x < height; x++)
+        for (int y = 0; y < width; y++)
+            for (int z = 0; z < depth; z++, cell++) {
+                int code = get_cell(x, y, z);
+                int instance = get_cell_instances()[cell];
+                if (code == 1 || code == 4) {
+                    expected_walls++;
+                    if (!assertEquals(-2, instance, "wall cell in region 0")) return false;
+                } else if (code == 0) {
+                    if (!assertEquals(-1, instance, "hidden cell in region 0")) return false;
+                } else {
+                    expected++;
+                    if (!assertTrue(instance >= 0 && instance < count, "visible cell has an instance")) return false;
+                    if (!assertEquals(cell, get_instance_cells(0)[instance], "cell of the instance")) return false;
+                    const float* matrix = get_instance_matrices(0) + instance * 16;
+                    if (!assertTrue(matrix[0] == 1.0f && matrix[15] == 1.0f && matrix[13] == y + 0.5f &&
+                                    matrix[12] == x - (height - 1) * 0.5f && matrix[14] == z - (depth - 1) * 0.5f,
+                                    "instance matrix")) return false;
+                    if (code == 2 && !assertTrue(get_instance_opacities(0)[instance] == 0.5f, "instance opacity")) return false;
+                }
+            }
+    return assertEquals(expected, count, "visible instances") && assertEquals(expected_walls, walls, "wall instances");
+}
+
+bool testPopAllRobotStates() {
+    // The transitions of the old chain of rules
+    const int expected[3][3] = {{4, 1, 3}, {4, 1, 3}, {5, 5, 0}};
+    robots[0] = Robot(Vector3Int(1, 1, 1));
+    for (int prev = 0; prev < 3; prev++) {
+        for (int curr = 0; curr < 3; curr++) {
+            prev_robot_states[0] = (RobotState)prev;
+            curr_robot_states[0] = (RobotState)curr;
+            if (!assertEquals(expected[prev][curr], pop_robot_state(0) & 7, "diff of a state transition")) return false;
+        }
+    }
+
+    // The batch gives the same bytes and leaves the same states as a call per robot
+    load_map(1);
+    set_active_probability(60);
+    for (int step = 0; step < 30; step++) simulate_step();
+    std::vector<RobotState> prev(prev_robot_states, prev_robot_states + robot_count);
+    std::vector<RobotState> curr(curr_robot_states, curr_robot_states + robot_count);
+    std::vector<int> single;
+    for (int i = 0; i < robot_count; i++) single.push_back(pop_robot_state(i));
+    std::copy(prev.begin(), prev.end(), prev_robot_states);
+    std::copy(curr.begin(), curr.end(), curr_robot_states);
+    if (!assertEquals(robot_count, pop_all_robot_states(get_robot_state_buffer(), MAX_ROBOTS), "every robot should be popped")) return false;
+    for (int i = 0; i < robot_count; i++) {
+        if (!assertEquals(single[i], get_robot_state_buffer()[i], "batched state of robot " + std::to_string(i))) return false;
+    }
+    return assertEquals(2, pop_all_robot_states(get_robot_state_buffer(), 2), "the batch should stop at max");
+}
+
+bool testSimulateSteps() {
+    load_map(1);
+    set_active_probability(100);
+    if (!assertEquals(5, simulate_steps(5), "all requested steps should run")) return false;
+    if (!assertEquals(5, get_simulation_steps(), "step counter after a batch")) return false;
+    int rest = simulate_steps(SIMULATE_UNTIL_COMPLETE);
+    if (!assertTrue(is_simulation_complete(), "the run should complete")) return false;
+    if (!assertEquals(get_makespan() - 5, rest, "the batch should stop at completion")) return false;
+    return assertEquals(0, simulate_steps(10), "a complete simulation should not step");
+}
+
+bool testEngineContexts() {
+    select_context(0);
+    load_map(1);
+    set_active_probability(100);
+    simulate_steps(SIMULATE_UNTIL_COMPLETE);
+    int makespan = get_makespan();
+    int t_total = get_t_total();
+
+    // Leave the first context in the middle of another map
+    load_map(0);
+    simulate_steps(3);
+    int steps = get_simulation_steps();
+    int robot_count_first = get_robot_count();
+
+    int second = create_context();
+    if (!assertTrue(second > 0, "a context should be created")) return false;
+    if (!assertTrue(select_context(second), "the new context should be selectable")) return false;
+    if (!assertEquals(0, get_robot_count(), "a new context should be empty")) return false;
+    load_map(1);
+    set_active_probability(100);
+    simulate_steps(SIMULATE_UNTIL_COMPLETE);
+    if (!assertEquals(makespan, get_makespan(), "the same run in another context")) return false;
+    if (!assertEquals(t_total, get_t_total(), "the same moves in another context")) return false;
+
+    select_context(0);
+    if (!assertEquals(steps, get_simulation_steps(), "the first context should keep its steps")) return false;
+    if (!assertEquals(robot_count_first, get_robot_count(), "the first context should keep its robots")) return false;
+
+    // The trajectory only records the steps of the context that started it
+    trajectory_start();
+    simulate_steps(2);
+    select_context(second);
+    load_map(0);
+    simulate_steps(5);
+    select_context(0);
+    simulate_step();
+    if (!assertTrue(trajectory_finish() > 0, "the recording should survive the other context")) return false;
+    if (!assertEquals(3, get_trajectory_steps(), "only the recording context's steps")) return false;
+    return assertTrue(!select_context(second + 1), "unknown contexts should not be selectable");
+}
+
 // Main function to run the tests
 int main() {
     TestFramework framework;
@@ -473,6 +716,36 @@ int main() {
     // Add the robot move priority test
     framework.addTest("Robot Move Priority", testRobotMovePriority);
 
+    // Compare the SIMD neighborhood kernel with the scalar path
+    framework.addTest("Neighborhood Gather Matches Scalar", testNeighborhoodGatherMatchesScalar);
+
+    // Repeated synchronous runs are answered from the memo
+    framework.addTest("Synchronous Run Memo", testSynchronousRunMemo);
+
+    // Streaming statistics merge across partial aggregates
+    framework.addTest("Stats Merge", testStatsMerge);
+
+    // Recorded trajectories replay every step
+    framework.addTest("Trajectory Replay", testTrajectoryReplay);
+
+    // The bulk render export agrees with get_cell
+    framework.addTest("Export Cells", testExportCells);
+
+    // Patching an exported grid with the dirty cells gives the grid after each step
+    framework.addTest("Dirty Cells", testDirtyCells);
+
+    // The batched robot diffs match pop_robot_state
+    framework.addTest("Pop All Robot States", testPopAllRobotStates);
+
+    // The engine writes the instance buffers of the renderer
+    framework.addTest("Export Instances", testExportInstances);
+
+    // Batched steps stop early once every robot settled
+    framework.addTest("Simulate Steps", testSimulateSteps);
+
+    // Independent simulations in one module
+    framework.addTest("Engine Contexts", testEngineContexts);
+
     // Run all the tests
     framework.runTests();
 
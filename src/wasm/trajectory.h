@@ -0,0 +1,168 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+// Binary trajectory of a run, written while simulating and read back to show
+// any step without simulating again. No standard library, it is part of the
+// WASM build. All integers are LEB128 varints unless noted.
+//
+//   header    "UDPT", version byte, grid size (x, y, z), start (x, y, z),
+//             keyframe interval, then the walkable bit of every cell (x, y, z
+//             loops, x outermost), least significant bit first
+//   keyframe  byte length (32 bit little endian), robot count, then per robot
+//             x, y, z and a flag byte (bit 0 active, bit 1 sleeping, bits 2-4
+//             last move)
+//   step      3 bit move code per robot that was active at the start of the
+//             step (0-5 moved in that direction, 6 stayed, 7 slept), padded to
+//             a byte; the settled robots as a count and index deltas; the
+//             number of robots spawned at the start position
+//   footer    fixed 32 bit little endian: keyframe count, keyframe interval,
+//             step count, keyframe offsets; then the footer offset and "UDPE"
+//
+// A keyframe describes the state after `i * interval` steps and comes before
+// the record of that step; the first one is the state the recording started from.
+
+constexpr int TRAJECTORY_VERSION = 1;
+constexpr int TRAJECTORY_KEYFRAME_INTERVAL = 64;
+constexpr int TRAJECTORY_MAX_KEYFRAMES = 4096; // Later steps are still recorded, seeking them replays from the last keyframe
+constexpr int TRAJECTORY_MOVE_STAYED = 6;
+constexpr int TRAJECTORY_MOVE_SLEPT = 7;
+constexpr int TRAJECTORY_FLAG_ACTIVE = 1;
+constexpr int TRAJECTORY_FLAG_SLEEPING = 2;
+constexpr int TRAJECTORY_FLAG_MOVE_SHIFT = 2;
+
+// Storage of the trajectory buffer, grows the block to at least `bytes` keeping
+// its content; nullptr if there is no memory left (defined in main.cpp)
+unsigned char* trajectory_reserve(unsigned long bytes);
+
+struct TrajectoryWriter {
+    unsigned char* data;
+    unsigned long size;
+    unsigned long capacity;
+    bool overflow; // Ran out of memory, the recording is incomplete
+    unsigned bit_buffer;
+    int bit_count;
+
+    void reset() {
+        size = 0;
+        overflow = false;
+        bit_buffer = 0;
+        bit_count = 0;
+    }
+
+    bool ensure(unsigned long bytes) {
+        if (overflow) return false;
+        if (size + bytes <= capacity) return true;
+        unsigned long wanted = capacity < 4096 ? 4096 : capacity;
+        while (wanted < size + bytes) wanted *= 2;
+        unsigned char* grown = trajectory_reserve(wanted);
+        if (!grown) {
+            overflow = true;
+            return false;
+        }
+        data = grown;
+        capacity = wanted;
+        return true;
+    }
+
+    void byte(unsigned value) {
+        if (ensure(1)) data[size++] = (unsigned char)value;
+    }
+
+    void varint(unsigned value) {
+        if (!ensure(5)) return;
+        while (value >= 0x80) {
+            data[size++] = (unsigned char)(value | 0x80);
+            value >>= 7;
+        }
+        data[size++] = (unsigned char)value;
+    }
+
+    void u32(unsigned value) {
+        if (!ensure(4)) return;
+        for (int i = 0; i < 4; i++) data[size++] = (unsigned char)(value >> (8 * i));
+    }
+
+    // Writes a u32 into an already written position
+    void patch_u32(unsigned long offset, unsigned value) {
+        for (int i = 0; i < 4; i++) data[offset + i] = (unsigned char)(value >> (8 * i));
+    }
+
+    // Packs `count` (at most 8) bits, least significant bit first
+    void bits(unsigned value, int count) {
+        bit_buffer |= (value & ((1u << count) - 1)) << bit_count;
+        bit_count += count;
+        while (bit_count >= 8) {
+            byte(bit_buffer & 0xff);
+            bit_buffer >>= 8;
+            bit_count -= 8;
+        }
+    }
+
+    void flush_bits() {
+        if (bit_count > 0) byte(bit_buffer & 0xff);
+        bit_buffer = 0;
+        bit_count = 0;
+    }
+};
+
+struct TrajectoryCursor {
+    const unsigned char* data;
+    unsigned long size;
+    unsigned long pos;
+    bool error; // Read past the end, the data is truncated or corrupt
+    unsigned bit_buffer;
+    int bit_count;
+
+    void seek(unsigned long offset) {
+        pos = offset;
+        error = offset > size;
+        bit_buffer = 0;
+        bit_count = 0;
+    }
+
+    unsigned byte() {
+        if (pos >= size) {
+            error = true;
+            return 0;
+        }
+        return data[pos++];
+    }
+
+    unsigned varint() {
+        unsigned value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            unsigned b = byte();
+            value |= (b & 0x7f) << shift;
+            if (!(b & 0x80)) return value;
+        }
+        error = true;
+        return 0;
+    }
+
+    unsigned u32_at(unsigned long offset) {
+        if (offset + 4 > size) {
+            error = true;
+            return 0;
+        }
+        return data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) | ((unsigned)data[offset + 3] << 24);
+    }
+
+    unsigned bits(int count) {
+        if (bit_count < count) {
+            bit_buffer |= byte() << bit_count;
+            bit_count += 8;
+        }
+        unsigned value = bit_buffer & ((1u << count) - 1);
+        bit_buffer >>= count;
+        bit_count -= count;
+        return value;
+    }
+
+    // Drops the padding bits of the last byte
+    void align() {
+        bit_buffer = 0;
+        bit_count = 0;
+    }
+};
+
+#endif // TRAJECTORY_H